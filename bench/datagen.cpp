@@ -0,0 +1,713 @@
+// Generates synthetic FOLIO data for scale testing of updates.
+//
+// Usage: ldp_datagen [options] <dir>
+//
+//   --records <n>     Total number of records in all tables, optionally
+//                     with a suffix K, M, or G (default: 1M)
+//   --tables <list>   Comma-separated tables to generate (default: all)
+//   --seed <n>        Random seed (default: 1)
+//   --page-size <n>   Records per page file (default: 100000)
+//   --source <name>   Source name in file names (default: none)
+//
+// The records are divided among the tables in proportions typical of
+// a FOLIO library, and references between tables (such as the
+// holdings record of an item) refer to generated records.  Page files
+// are written as <table>_<n>.json, or <table>_<source>_<n>.json if a
+// source name is given, in the format written by direct extraction,
+// together with <table>_count.txt files containing the number of
+// pages.  Without a source name, the directory can be loaded with
+// "ldp update --sourcedir <dir>".
+//
+// The output depends only on the seed, the number of records, and the
+// page size; each table is generated independently of which other
+// tables are selected.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// A splitmix64 generator, which gives the same sequence on every
+// platform.
+class rng {
+public:
+    rng(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+    // Returns a number in [0, n).
+    uint64_t below(uint64_t n) {
+        return n == 0 ? 0 : next() % n;
+    }
+    bool chance(unsigned int percent) {
+        return below(100) < percent;
+    }
+private:
+    uint64_t state;
+};
+
+static uint64_t hash_name(const string& s)
+{
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+class generator;
+
+typedef void (*record_fn)(const generator& g, rng* r, uint64_t n,
+                          string* rec);
+
+class table_spec {
+public:
+    const char* name;
+    unsigned int weight;
+    record_fn record;
+};
+
+class generator {
+public:
+    uint64_t seed;
+    // Number of records in each table, including tables that are not
+    // written, so that references are the same.
+    map<string,uint64_t> counts;
+    // Returns the id of record n of a table.
+    string id(const char* table, uint64_t n) const;
+    // Returns a random id of a record in a table.
+    string ref(const char* table, rng* r) const;
+    string timestamp(rng* r) const;
+};
+
+string generator::id(const char* table, uint64_t n) const
+{
+    rng r(seed ^ hash_name(table) ^ (n * 0x9e3779b97f4a7c15));
+    uint64_t a = r.next();
+    uint64_t b = r.next();
+    char buf[40];
+    snprintf(buf, sizeof buf, "%08" PRIx32 "-%04" PRIx32 "-4%03" PRIx32 "-%04" PRIx32 "-%012" PRIx64,
+             uint32_t(a >> 32), uint32_t((a >> 16) & 0xffff),
+             uint32_t(a & 0xfff), uint32_t(0x8000 | (b >> 50 & 0x3fff)),
+             b & 0xffffffffffff);
+    return buf;
+}
+
+string generator::ref(const char* table, rng* r) const
+{
+    auto c = counts.find(table);
+    uint64_t count = (c == counts.end() || c->second == 0) ? 1 : c->second;
+    return id(table, r->below(count));
+}
+
+string generator::timestamp(rng* r) const
+{
+    // Between 2015 and 2023.
+    time_t t = 1420070400 + time_t(r->below(9 * 365 * 86400));
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[40];
+    size_t len = strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + len, sizeof buf - len, ".%03u+00:00",
+             unsigned(r->below(1000)));
+    return buf;
+}
+
+static const char* words[] = {
+    "library", "history", "science", "annual", "report", "journal",
+    "studies", "america", "world", "modern", "poetry", "letters",
+    "introduction", "theory", "practice", "society", "culture", "music",
+    "art", "review", "proceedings", "national", "survey", "guide",
+    "handbook", "economic", "political", "early", "century", "new"
+};
+static const char* first_names[] = {
+    "Ana", "Ben", "Chen", "Dara", "Eli", "Fatima", "Gus", "Hana", "Ivan",
+    "Jo", "Kai", "Lena", "Mo", "Nia", "Omar", "Pia"
+};
+static const char* last_names[] = {
+    "Abbott", "Brown", "Cruz", "Diaz", "Evans", "Fox", "Gupta", "Haddad",
+    "Ito", "Jones", "Kim", "Lopez", "Mensah", "Novak"
+};
+
+template <size_t N>
+static const char* pick(const char* (&list)[N], rng* r)
+{
+    return list[r->below(N)];
+}
+
+static string phrase(rng* r, unsigned int min, unsigned int max)
+{
+    string s;
+    unsigned int n = min + unsigned(r->below(max - min + 1));
+    for (unsigned int x = 0; x < n; x++) {
+        if (x > 0)
+            s += ' ';
+        s += pick(words, r);
+    }
+    return s;
+}
+
+static string digits(rng* r, int n)
+{
+    string s;
+    for (int x = 0; x < n; x++)
+        s += char('0' + r->below(10));
+    return s;
+}
+
+// Returns "Last, First", or "First Last" if inverted is false.
+static string person_name(rng* r, bool inverted)
+{
+    string first = pick(first_names, r);
+    string last = pick(last_names, r);
+    return inverted ? last + ", " + first : first + " " + last;
+}
+
+static string call_number(rng* r)
+{
+    string cls = to_string(1 + r->below(999));
+    char cutter = char('A' + r->below(26));
+    return "QA" + cls + " ." + cutter + digits(r, 2);
+}
+
+// Appends fields to a JSON object in the text format of PostgreSQL.
+class json_object {
+public:
+    json_object(string* out) : out(out) { *out += '{'; }
+    json_object& str(const char* key, const string& value) {
+        return raw(key, "\"" + value + "\"");
+    }
+    json_object& num(const char* key, uint64_t value) {
+        return raw(key, to_string(value));
+    }
+    json_object& boolean(const char* key, bool value) {
+        return raw(key, value ? "true" : "false");
+    }
+    json_object& raw(const char* key, const string& value) {
+        if (!first)
+            *out += ", ";
+        first = false;
+        *out += string("\"") + key + "\": " + value;
+        return *this;
+    }
+    void end() { *out += '}'; }
+private:
+    string* out;
+    bool first = true;
+};
+
+static string metadata(const generator& g, rng* r)
+{
+    string s;
+    string user = g.ref("user_users", r);
+    json_object(&s)
+        .str("createdDate", g.timestamp(r))
+        .str("updatedDate", g.timestamp(r))
+        .str("createdByUserId", user)
+        .str("updatedByUserId", r->chance(70) ? user : g.ref("user_users", r))
+        .end();
+    return s;
+}
+
+// Reference data, such as locations, are small sets of ids.
+static string reference(const generator& g, const char* table,
+                        uint64_t count, rng* r)
+{
+    return g.id(table, r->below(count));
+}
+
+static void inventory_instance(const generator& g, rng* r, uint64_t n,
+                               string* rec)
+{
+    string title = phrase(r, 2, 10);
+    title[0] = char(toupper(title[0]));
+    string contributors = "[";
+    uint64_t nc = 1 + r->below(3);
+    for (uint64_t x = 0; x < nc; x++) {
+        if (x > 0)
+            contributors += ", ";
+        json_object(&contributors)
+            .str("name", person_name(r, true))
+            .str("contributorNameTypeId", reference(g, "inventory_contributor_name_types", 3, r))
+            .boolean("primary", x == 0)
+            .end();
+    }
+    contributors += "]";
+    string identifiers = "[";
+    json_object(&identifiers)
+        .str("value", "978" + digits(r, 10))
+        .str("identifierTypeId", reference(g, "inventory_identifier_types", 8, r))
+        .end();
+    identifiers += "]";
+    string subjects = "[";
+    uint64_t ns = r->below(6);
+    for (uint64_t x = 0; x < ns; x++)
+        subjects += string(x > 0 ? ", " : "") + "\"" + phrase(r, 1, 3) + "\"";
+    subjects += "]";
+    string publication = "[";
+    json_object(&publication)
+        .str("publisher", phrase(r, 1, 2) + " Press")
+        .str("place", "Springfield")
+        .str("dateOfPublication", to_string(1900 + r->below(124)))
+        .end();
+    publication += "]";
+    json_object(rec)
+        .str("id", g.id("inventory_instances", n))
+        .num("_version", 1 + r->below(5))
+        .str("hrid", "in" + to_string(100000000 + n))
+        .str("source", "MARC")
+        .str("title", title)
+        .str("indexTitle", title)
+        .raw("alternativeTitles", "[]")
+        .raw("editions", "[]")
+        .raw("series", "[]")
+        .raw("identifiers", identifiers)
+        .raw("contributors", contributors)
+        .raw("subjects", subjects)
+        .raw("classifications", "[]")
+        .raw("publication", publication)
+        .raw("electronicAccess", "[]")
+        .str("instanceTypeId", reference(g, "inventory_instance_types", 20, r))
+        .raw("instanceFormatIds", "[]")
+        .raw("physicalDescriptions", "[\"" + to_string(50 + r->below(800)) + " pages ; 24 cm\"]")
+        .raw("languages", "[\"eng\"]")
+        .raw("notes", "[]")
+        .str("modeOfIssuanceId", reference(g, "inventory_modes_of_issuance", 4, r))
+        .boolean("previouslyHeld", false)
+        .boolean("staffSuppress", false)
+        .boolean("discoverySuppress", r->chance(3))
+        .raw("statisticalCodeIds", "[]")
+        .str("statusId", reference(g, "inventory_instance_statuses", 5, r))
+        .str("statusUpdatedDate", g.timestamp(r))
+        .raw("tags", "{\"tagList\": []}")
+        .raw("natureOfContentTermIds", "[]")
+        .raw("metadata", metadata(g, r))
+        .end();
+}
+
+static void inventory_holdings(const generator& g, rng* r, uint64_t n,
+                               string* rec)
+{
+    string location = reference(g, "inventory_locations", 40, r);
+    json_object(rec)
+        .str("id", g.id("inventory_holdings", n))
+        .num("_version", 1 + r->below(3))
+        .str("hrid", "ho" + to_string(100000000 + n))
+        .str("instanceId", g.ref("inventory_instances", r))
+        .raw("formerIds", "[]")
+        .str("permanentLocationId", location)
+        .str("effectiveLocationId", location)
+        .raw("electronicAccess", "[]")
+        .str("callNumberTypeId", reference(g, "inventory_call_number_types", 6, r))
+        .str("callNumber", call_number(r))
+        .raw("notes", "[]")
+        .raw("holdingsStatements", "[]")
+        .raw("holdingsStatementsForIndexes", "[]")
+        .raw("holdingsStatementsForSupplements", "[]")
+        .raw("statisticalCodeIds", "[]")
+        .str("sourceId", reference(g, "inventory_holdings_sources", 2, r))
+        .boolean("discoverySuppress", false)
+        .raw("metadata", metadata(g, r))
+        .end();
+}
+
+static void inventory_item(const generator& g, rng* r, uint64_t n,
+                           string* rec)
+{
+    string notes = "[";
+    uint64_t nn = r->chance(70) ? 0 : 1 + r->below(2);
+    for (uint64_t x = 0; x < nn; x++) {
+        if (x > 0)
+            notes += ", ";
+        json_object(&notes)
+            .str("note", phrase(r, 3, 12))
+            .boolean("staffOnly", r->chance(50))
+            .str("itemNoteTypeId", reference(g, "inventory_item_note_types", 6, r))
+            .end();
+    }
+    notes += "]";
+    static const char* statuses[] = {
+        "Available", "Available", "Available", "Checked out", "In transit",
+        "Missing"
+    };
+    string status;
+    json_object(&status)
+        .str("name", pick(statuses, r))
+        .str("date", g.timestamp(r))
+        .end();
+    string location = reference(g, "inventory_locations", 40, r);
+    json_object obj(rec);
+    obj.str("id", g.id("inventory_items", n))
+        .num("_version", 1 + r->below(5))
+        .str("hrid", "it" + to_string(100000000 + n))
+        .str("holdingsRecordId", g.ref("inventory_holdings", r))
+        .raw("formerIds", "[]")
+        .boolean("discoverySuppress", r->chance(5))
+        .str("barcode", "3900" + digits(r, 10))
+        .str("itemLevelCallNumber", "QA" + to_string(1 + r->below(999)))
+        .str("copyNumber", to_string(1 + r->below(3)))
+        .raw("yearCaption", "[]")
+        .raw("administrativeNotes", "[]")
+        .raw("notes", notes)
+        .raw("circulationNotes", "[]")
+        .raw("status", status)
+        .str("materialTypeId", reference(g, "inventory_material_types", 10, r))
+        .str("permanentLoanTypeId", reference(g, "inventory_loan_types", 4, r))
+        .str("permanentLocationId", location)
+        .str("effectiveLocationId", location)
+        .raw("electronicAccess", "[]")
+        .raw("statisticalCodeIds", "[]")
+        .raw("tags", "{\"tagList\": []}")
+        .raw("metadata", metadata(g, r));
+    if (r->chance(30))
+        obj.str("enumeration", "v." + to_string(1 + r->below(40)));
+    obj.end();
+}
+
+static void srs_record(const generator& g, rng* r, uint64_t n, string* rec)
+{
+    json_object(rec)
+        .str("id", g.id("srs_records", n))
+        .str("snapshotId", reference(g, "srs_snapshots", 100, r))
+        .str("matchedId", g.id("srs_records", n))
+        .num("generation", 0)
+        .str("recordType", "MARC_BIB")
+        .str("externalId", g.ref("inventory_instances", r))
+        .str("state", "ACTUAL")
+        .str("leaderRecordStatus", r->chance(90) ? "n" : "c")
+        .num("order", r->below(1000))
+        .boolean("suppressDiscovery", r->chance(3))
+        .str("createdByUserId", g.ref("user_users", r))
+        .str("createdDate", g.timestamp(r))
+        .str("updatedByUserId", g.ref("user_users", r))
+        .str("updatedDate", g.timestamp(r))
+        .str("externalHrid", "in" + to_string(100000000 + r->below(1000000)))
+        .end();
+}
+
+static string marc_field(const char* tag, const char* ind1, const char* ind2,
+                         const vector<pair<string,string>>& subfields)
+{
+    string sf = "[";
+    for (size_t x = 0; x < subfields.size(); x++) {
+        if (x > 0)
+            sf += ", ";
+        sf += "{\"" + subfields[x].first + "\": \"" + subfields[x].second + "\"}";
+    }
+    sf += "]";
+    string inner;
+    json_object(&inner)
+        .str("ind1", ind1)
+        .str("ind2", ind2)
+        .raw("subfields", sf)
+        .end();
+    return string("{\"") + tag + "\": " + inner + "}";
+}
+
+static void srs_marc(const generator& g, rng* r, uint64_t n, string* rec)
+{
+    string fields = "[";
+    fields += "{\"001\": \"in" + to_string(100000000 + n) + "\"}, ";
+    fields += "{\"005\": \"20230101120000.0\"}, ";
+    fields += "{\"008\": \"190101s" + to_string(1900 + r->below(124)) + "    ilu           000 0 eng d\"}, ";
+    fields += marc_field("020", " ", " ", {{"a", "978" + digits(r, 10)}}) + ", ";
+    fields += marc_field("100", "1", " ", {{"a", person_name(r, true)}}) + ", ";
+    fields += marc_field("245", "1", "0", {{"a", phrase(r, 2, 10) + " /"}, {"c", person_name(r, false) + "."}}) + ", ";
+    fields += marc_field("264", " ", "1", {{"a", "Springfield :"}, {"b", phrase(r, 1, 2) + " Press,"}, {"c", to_string(1900 + r->below(124)) + "."}}) + ", ";
+    fields += marc_field("300", " ", " ", {{"a", to_string(50 + r->below(800)) + " pages ;"}, {"c", "24 cm"}}) + ", ";
+    uint64_t nsubjects = 1 + r->below(8);
+    for (uint64_t x = 0; x < nsubjects; x++)
+        fields += marc_field("650", " ", "0", {{"a", phrase(r, 1, 3)}, {"x", phrase(r, 1, 1) + "."}}) + ", ";
+    if (r->chance(40))
+        fields += marc_field("500", " ", " ", {{"a", phrase(r, 5, 30) + "."}}) + ", ";
+    fields += marc_field("999", "f", "f", {{"s", g.id("srs_records", n)}, {"i", g.ref("inventory_instances", r)}});
+    fields += "]";
+    string length = digits(r, 5);
+    string base = digits(r, 3);
+    json_object(rec)
+        .str("id", g.id("srs_records", n))
+        .raw("fields", fields)
+        .str("leader", length + "cam a2200" + base + " i 4500")
+        .end();
+}
+
+static void circulation_loan(const generator& g, rng* r, uint64_t n,
+                             string* rec)
+{
+    bool closed = r->chance(80);
+    static const char* actions[] = {"checkedout", "checkedin", "renewed"};
+    json_object obj(rec);
+    obj.str("id", g.id("circulation_loans", n))
+        .str("userId", g.ref("user_users", r))
+        .str("itemId", g.ref("inventory_items", r))
+        .str("itemEffectiveLocationIdAtCheckOut", reference(g, "inventory_locations", 40, r))
+        .str("action", closed ? "checkedin" : pick(actions, r))
+        .str("loanDate", g.timestamp(r))
+        .str("dueDate", g.timestamp(r))
+        .raw("status", closed ? "{\"name\": \"Closed\"}" : "{\"name\": \"Open\"}")
+        .str("loanPolicyId", reference(g, "circulation_loan_policies", 8, r))
+        .str("overdueFinePolicyId", reference(g, "feesfines_overdue_fines_policies", 4, r))
+        .str("lostItemPolicyId", reference(g, "feesfines_lost_item_fees_policies", 4, r))
+        .num("renewalCount", r->below(7))
+        .str("checkoutServicePointId", reference(g, "inventory_service_points", 5, r));
+    if (closed) {
+        string returned = g.timestamp(r);
+        obj.str("returnDate", returned)
+            .str("systemReturnDate", returned)
+            .str("checkinServicePointId", reference(g, "inventory_service_points", 5, r));
+    }
+    obj.raw("metadata", metadata(g, r)).end();
+}
+
+static void circulation_request(const generator& g, rng* r, uint64_t n,
+                                string* rec)
+{
+    static const char* types[] = {"Hold", "Page", "Recall"};
+    static const char* statuses[] = {
+        "Open - Not yet filled", "Open - Awaiting pickup", "Closed - Filled",
+        "Closed - Cancelled"
+    };
+    json_object(rec)
+        .str("id", g.id("circulation_requests", n))
+        .str("requestType", pick(types, r))
+        .str("requestLevel", "Item")
+        .str("requestDate", g.timestamp(r))
+        .str("requesterId", g.ref("user_users", r))
+        .str("itemId", g.ref("inventory_items", r))
+        .str("instanceId", g.ref("inventory_instances", r))
+        .str("holdingsRecordId", g.ref("inventory_holdings", r))
+        .str("status", pick(statuses, r))
+        .num("position", 1 + r->below(5))
+        .str("fulfillmentPreference", "Hold Shelf")
+        .str("pickupServicePointId", reference(g, "inventory_service_points", 5, r))
+        .raw("metadata", metadata(g, r))
+        .end();
+}
+
+static void user_user(const generator& g, rng* r, uint64_t n, string* rec)
+{
+    string first = pick(first_names, r);
+    string last = pick(last_names, r);
+    string address;
+    json_object(&address)
+        .str("countryId", "US")
+        .str("addressLine1", to_string(1 + r->below(999)) + " " + last + " St")
+        .str("city", "Springfield")
+        .str("region", "IL")
+        .str("postalCode", digits(r, 5))
+        .str("addressTypeId", reference(g, "user_addresstypes", 3, r))
+        .boolean("primaryAddress", true)
+        .end();
+    string personal;
+    json_object(&personal)
+        .str("lastName", last)
+        .str("firstName", first)
+        .str("email", first + "." + last + to_string(n) + "@example.edu")
+        .str("phone", "555-" + digits(r, 4))
+        .raw("addresses", "[" + address + "]")
+        .str("preferredContactTypeId", "002")
+        .end();
+    json_object(rec)
+        .str("id", g.id("user_users", n))
+        .str("username", first + last + to_string(n))
+        .str("externalSystemId", digits(r, 8))
+        .str("barcode", "2100" + digits(r, 10))
+        .boolean("active", r->chance(90))
+        .str("type", "patron")
+        .str("patronGroup", reference(g, "user_groups", 6, r))
+        .raw("departments", "[]")
+        .raw("proxyFor", "[]")
+        .raw("personal", personal)
+        .str("enrollmentDate", g.timestamp(r))
+        .str("expirationDate", g.timestamp(r))
+        .str("createdDate", g.timestamp(r))
+        .str("updatedDate", g.timestamp(r))
+        .raw("metadata", metadata(g, r))
+        .end();
+}
+
+// Proportions of records in each table.
+static const table_spec tables[] = {
+    {"inventory_instances", 18, inventory_instance},
+    {"inventory_holdings", 18, inventory_holdings},
+    {"inventory_items", 20, inventory_item},
+    {"srs_records", 18, srs_record},
+    {"srs_marc", 18, srs_marc},
+    {"circulation_loans", 5, circulation_loan},
+    {"circulation_requests", 1, circulation_request},
+    {"user_users", 2, user_user}
+};
+
+static void write_table(const generator& g, const table_spec& t,
+                        const string& dir, const string& source,
+                        uint64_t page_size)
+{
+    auto start = chrono::steady_clock::now();
+    uint64_t count = g.counts.at(t.name);
+    string prefix = (fs::path(dir) / t.name).string();
+    if (source != "")
+        prefix += "_" + source;
+    rng r(g.seed ^ hash_name(t.name));
+    uint64_t pages = (count + page_size - 1) / page_size;
+    uint64_t bytes = 0;
+    string rec;
+    for (uint64_t p = 0; p < pages; p++) {
+        string filename = prefix + "_" + to_string(p) + ".json";
+        FILE* f = fopen(filename.c_str(), "w");
+        if (f == nullptr)
+            throw runtime_error("unable to open file: " + filename);
+        fputs("{\n  \"a\": [\n", f);
+        uint64_t end = min(count, (p + 1) * page_size);
+        for (uint64_t n = p * page_size; n < end; n++) {
+            rec = (n == p * page_size ? "  " : ",\n  ");
+            t.record(g, &r, n, &rec);
+            fwrite(rec.data(), 1, rec.size(), f);
+            bytes += rec.size();
+        }
+        fputs("\n  ]\n}\n", f);
+        if (ferror(f) || fclose(f) != 0)
+            throw runtime_error("error writing file: " + filename);
+    }
+    string count_file = prefix + "_count.txt";
+    FILE* f = fopen(count_file.c_str(), "w");
+    if (f == nullptr)
+        throw runtime_error("unable to open file: " + count_file);
+    fprintf(f, "%" PRIu64 "\n", pages);
+    if (ferror(f) || fclose(f) != 0)
+        throw runtime_error("error writing file: " + count_file);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() -
+                                              start).count();
+    fprintf(stderr, "ldp_datagen: %s: %" PRIu64 " records, %" PRIu64
+            " pages, %.0f MB (%.1f s)\n", t.name, count, pages, bytes / 1e6,
+            elapsed);
+}
+
+static uint64_t parse_count(const char* s)
+{
+    char* end;
+    uint64_t n = strtoull(s, &end, 10);
+    if (end == s)
+        throw runtime_error(string("invalid number: ") + s);
+    switch (*end) {
+    case '\0':
+        return n;
+    case 'K':
+    case 'k':
+        n *= 1000;
+        break;
+    case 'M':
+    case 'm':
+        n *= 1000000;
+        break;
+    case 'G':
+    case 'g':
+        n *= 1000000000;
+        break;
+    default:
+        throw runtime_error(string("invalid number: ") + s);
+    }
+    if (end[1] != '\0')
+        throw runtime_error(string("invalid number: ") + s);
+    return n;
+}
+
+static const char* usage =
+"Usage: ldp_datagen [options] <dir>\n"
+"\n"
+"Options:\n"
+"  --records <n>     - Total number of records in all tables, optionally\n"
+"                      with a suffix K, M, or G (default: 1M)\n"
+"  --tables <list>   - Comma-separated tables to generate (default: all)\n"
+"  --seed <n>        - Random seed (default: 1)\n"
+"  --page-size <n>   - Records per page file (default: 100000)\n"
+"  --source <name>   - Source name in file names (default: none)\n";
+
+int main(int argc, char* argv[])
+{
+    uint64_t records = 1000000;
+    uint64_t page_size = 100000;
+    uint64_t seed = 1;
+    string source;
+    string dir;
+    vector<string> selected;
+    try {
+        for (int x = 1; x < argc; x++) {
+            string arg = argv[x];
+            if (arg[0] == '-' && x + 1 >= argc)
+                throw runtime_error("missing value for option: " + arg);
+            if (arg == "--records") {
+                records = parse_count(argv[++x]);
+            } else if (arg == "--tables") {
+                string list = argv[++x];
+                size_t pos = 0;
+                while (pos <= list.size()) {
+                    size_t comma = list.find(',', pos);
+                    if (comma == string::npos)
+                        comma = list.size();
+                    if (comma > pos)
+                        selected.push_back(list.substr(pos, comma - pos));
+                    pos = comma + 1;
+                }
+            } else if (arg == "--seed") {
+                seed = parse_count(argv[++x]);
+            } else if (arg == "--page-size") {
+                page_size = parse_count(argv[++x]);
+            } else if (arg == "--source") {
+                source = argv[++x];
+            } else if (arg[0] == '-' || dir != "") {
+                throw runtime_error("unknown argument: " + arg);
+            } else {
+                dir = arg;
+            }
+        }
+        if (dir == "" || page_size == 0) {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+        for (auto& s : selected) {
+            bool found = false;
+            for (auto& t : tables)
+                found = found || (s == t.name);
+            if (!found)
+                throw runtime_error("unknown table: " + s);
+        }
+
+        generator g;
+        g.seed = seed;
+        unsigned int total_weight = 0;
+        for (auto& t : tables)
+            total_weight += t.weight;
+        for (auto& t : tables)
+            g.counts[t.name] = max(uint64_t(1), records / total_weight * t.weight +
+                                   records % total_weight * t.weight / total_weight);
+
+        fs::create_directories(dir);
+        for (auto& t : tables) {
+            if (selected.empty() ||
+                    find(selected.begin(), selected.end(), t.name) != selected.end())
+                write_table(g, t, dir, source, page_size);
+        }
+    } catch (exception& e) {
+        fprintf(stderr, "ldp_datagen: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,291 @@
+// Microbenchmarks of the functions used to stage each record.
+//
+// Usage: ldp_bench [-t <seconds>] [<corpus_dir>]
+//
+// Each file <table>.json in the corpus directory is a page of records
+// for an LDP table, in the format written by extraction.  Times are
+// reported per record, or per value for functions that are called on
+// single strings, together with the throughput of the input.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/anonymize.h"
+#include "../src/camelcase.h"
+#include "../src/dbtype.h"
+#include "../src/log.h"
+#include "../src/options.h"
+#include "../src/schema.h"
+#include "../src/stage.h"
+#include "../src/util.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#ifndef LDP_BENCH_DATA
+#define LDP_BENCH_DATA "bench/data"
+#endif
+
+using namespace std;
+
+namespace fs = std::filesystem;
+namespace json = rapidjson;
+
+// Keeps results of benchmarked functions from being optimized away.
+static volatile size_t sink;
+
+static double min_time = 1.0;
+
+class corpus {
+public:
+    table_schema table;
+    // The page as extracted.
+    string page;
+    // Each record, and its compact JSON size.
+    vector<unique_ptr<json::Document>> records;
+    size_t record_bytes = 0;
+    // All string values and field names in the records.
+    vector<string> values;
+    vector<string> keys;
+};
+
+static void collect_strings(const json::Value& v, corpus* c)
+{
+    if (v.IsString()) {
+        c->values.push_back(v.GetString());
+    } else if (v.IsObject()) {
+        for (auto m = v.MemberBegin(); m != v.MemberEnd(); ++m) {
+            c->keys.push_back(m->name.GetString());
+            collect_strings(m->value, c);
+        }
+    } else if (v.IsArray()) {
+        for (auto e = v.Begin(); e != v.End(); ++e)
+            collect_strings(*e, c);
+    }
+}
+
+static void read_corpus(const fs::path& file, const ldp_schema& schema,
+                        const ldp_options& opt, ldp_log* lg,
+                        const dbtype& dbt, corpus* c)
+{
+    string name = file.stem();
+    auto t = find_if(schema.tables.begin(), schema.tables.end(),
+                     [&](const table_schema& ts) { return ts.name == name; });
+    if (t != schema.tables.end()) {
+        c->table = *t;
+    } else {
+        c->table.name = name;
+        c->table.source_type = data_source_type::rmb;
+    }
+
+    ifstream in(file);
+    stringstream ss;
+    ss << in.rdbuf();
+    c->page = ss.str();
+
+    json::Document doc;
+    doc.Parse(c->page.c_str());
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("a") ||
+            !doc["a"].IsArray())
+        throw runtime_error("unable to read corpus: " + file.string());
+    for (auto r = doc["a"].Begin(); r != doc["a"].End(); ++r) {
+        json::StringBuffer buffer;
+        json::Writer<json::StringBuffer> writer(buffer);
+        r->Accept(writer);
+        unique_ptr<json::Document> record(new json::Document());
+        record->Parse(buffer.GetString());
+        c->record_bytes += buffer.GetSize();
+        c->records.push_back(move(record));
+        collect_strings(*r, c);
+    }
+
+    // Infer the columns as in pass 1 of staging.
+    field_set drop_fields;
+    map<string,type_counts> stats;
+    parse_page_text(opt, lg, 1, c->table, dbt, &drop_fields, &stats,
+                    c->page.c_str(), nullptr);
+    if (!infer_columns(lg, c->table, stats, c->records.size(),
+                       &(c->table.columns)))
+        throw runtime_error("unable to infer columns: " + name);
+}
+
+static size_t total_size(const vector<string>& strings)
+{
+    size_t size = 0;
+    for (auto& s : strings)
+        size += s.size();
+    return size;
+}
+
+// Runs f repeatedly for at least min_time seconds, where each call
+// processes the given number of items and bytes.
+static void run(const string& name, size_t items, size_t bytes,
+                const function<void()>& f)
+{
+    if (items == 0)
+        return;
+    f();
+    size_t iterations = 0;
+    double elapsed;
+    auto start = chrono::steady_clock::now();
+    do {
+        f();
+        iterations++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() -
+                                           start).count();
+    } while (elapsed < min_time);
+    double ns_per_item = elapsed * 1e9 / (double(iterations) * items);
+    double mb_per_s = double(bytes) * iterations / elapsed / 1e6;
+    printf("%-48s %10zu %12.1f %10.1f\n", name.c_str(), items, ns_per_item,
+           mb_per_s);
+    fflush(stdout);
+}
+
+static void run_corpus(const ldp_options& opt, ldp_log* lg,
+                       const dbtype& dbt, corpus* c)
+{
+    const table_schema& table = c->table;
+    field_set drop_fields;
+    size_t n = c->records.size();
+    string prefix = table.name + ": ";
+
+    run(prefix + "JSONHandler pass 1", n, c->page.size(), [&] {
+        map<string,type_counts> stats;
+        parse_page_text(opt, lg, 1, table, dbt, &drop_fields, &stats,
+                        c->page.c_str(), nullptr);
+        sink = stats.size();
+    });
+
+    string copy_buffer;
+    run(prefix + "JSONHandler pass 2", n, c->page.size(), [&] {
+        copy_buffer.clear();
+        parse_page_text(opt, lg, 2, table, dbt, &drop_fields, nullptr,
+                        c->page.c_str(), &copy_buffer);
+        sink = copy_buffer.size();
+    });
+
+    run(prefix + "process_json_record", n, c->record_bytes, [&] {
+        map<string,type_counts> stats;
+        for (auto& r : c->records)
+            process_json_record(table, r.get(), r.get(), true,
+                                opt.flatten_depth, &drop_fields, "", 0,
+                                &stats, true);
+        sink = stats.size();
+    });
+
+    run(prefix + "writeTuple", n, c->record_bytes, [&] {
+        copy_buffer.clear();
+        size_t record_count = 0, total_record_count = 0;
+        for (auto& r : c->records)
+            writeTuple(opt, lg, dbt, table, *r, &record_count,
+                       &total_record_count, &copy_buffer, nullptr, nullptr,
+                       nullptr);
+        sink = copy_buffer.size();
+    });
+
+    size_t value_bytes = total_size(c->values);
+    run(prefix + "dbtype::encode_copy (per value)", c->values.size(),
+        value_bytes, [&] {
+        string s;
+        size_t size = 0;
+        for (auto& v : c->values) {
+            dbt.encode_copy(v.c_str(), &s);
+            size += s.size();
+        }
+        sink = size;
+    });
+
+    run(prefix + "encode_json (per value)", c->values.size(), value_bytes,
+        [&] {
+        string s;
+        size_t size = 0;
+        for (auto& v : c->values) {
+            s.clear();
+            encode_json(v.c_str(), &s);
+            size += s.size();
+        }
+        sink = size;
+    });
+
+    run(prefix + "decode_camel_case (per key)", c->keys.size(),
+        total_size(c->keys), [&] {
+        string s;
+        size_t size = 0;
+        for (auto& k : c->keys) {
+            decode_camel_case(k.c_str(), &s);
+            size += s.size();
+        }
+        sink = size;
+    });
+
+    run(prefix + "is_uuid (per value)", c->values.size(), value_bytes, [&] {
+        size_t count = 0;
+        for (auto& v : c->values)
+            count += is_uuid(v.c_str());
+        sink = count;
+    });
+
+    run(prefix + "looks_like_date_time (per value)", c->values.size(),
+        value_bytes, [&] {
+        size_t count = 0;
+        for (auto& v : c->values)
+            count += looks_like_date_time(v.c_str());
+        sink = count;
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    string dir = LDP_BENCH_DATA;
+    for (int x = 1; x < argc; x++) {
+        if (strcmp(argv[x], "-t") == 0 && x + 1 < argc) {
+            min_time = atof(argv[++x]);
+        } else if (argv[x][0] == '-') {
+            fprintf(stderr, "Usage: ldp_bench [-t <seconds>] [<corpus_dir>]\n");
+            return 1;
+        } else {
+            dir = argv[x];
+        }
+    }
+
+    try {
+        ldp_options opt;
+        ldp_log lg(log_level::info, false, true, nullptr);
+        dbtype dbt(nullptr);
+        ldp_schema schema;
+        ldp_schema::make_default_schema(&schema);
+
+        vector<fs::path> files;
+        for (auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().extension() == ".json")
+                files.push_back(entry.path());
+        }
+        sort(files.begin(), files.end());
+        if (files.empty())
+            throw runtime_error("no corpus files found in: " + dir);
+
+        printf("%-48s %10s %12s %10s\n", "benchmark", "items", "ns/item",
+               "MB/s");
+        for (auto& file : files) {
+            corpus c;
+            read_corpus(file, schema, opt, &lg, dbt, &c);
+            run_corpus(opt, &lg, dbt, &c);
+        }
+    } catch (runtime_error& e) {
+        fprintf(stderr, "ldp_bench: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,7 +1,11 @@
 #ifndef ETYMON_POSTGRES_H
 #define ETYMON_POSTGRES_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <vector>
 #include <libpq-fe.h>
 
 using namespace std;
@@ -23,6 +27,49 @@ public:
     PGconn* conn;
     pgconn(const pgconn_info& info);
     ~pgconn();
+    static size_t opened();
+};
+
+/**
+ * \brief Reuses database connections.
+ *
+ * Connections are leased with acquire() and returned with release(),
+ * usually via pgconn_lease.  An idle connection is checked before it
+ * is reused, and a connection is closed instead of being kept if it has
+ * failed or is left in a transaction.  Leased connections should be
+ * returned without changes to session settings.
+ *
+ * A pool is not shared with child processes: after fork(), a child
+ * opens a new connection for each lease and closes it on release.
+ */
+class pgconn_pool {
+public:
+    pgconn_pool(const pgconn_info& info, size_t max_idle);
+    ~pgconn_pool();
+    pgconn* acquire();
+    void release(pgconn* conn);
+    size_t opened() const;
+    size_t reused() const;
+    size_t discarded() const;
+private:
+    bool check(pgconn* conn);
+    pgconn_info info;
+    size_t max_idle;
+    pid_t owner;
+    mutex idle_mutex;
+    vector<pgconn*> idle;
+    atomic<size_t> open_count{0};
+    atomic<size_t> reuse_count{0};
+    atomic<size_t> discard_count{0};
+};
+
+class pgconn_lease {
+public:
+    pgconn* conn;
+    pgconn_lease(pgconn_pool* pool);
+    ~pgconn_lease();
+private:
+    pgconn_pool* pool;
 };
 
 class pgconn_result {
@@ -32,6 +79,37 @@ public:
     ~pgconn_result();
 };
 
+/**
+ * \brief Sends a sequence of commands and collects their results
+ * together.
+ *
+ * Commands are queued with add() and sent by execute().  When libpq
+ * supports pipeline mode, the commands are sent without waiting for
+ * each result, which avoids a network round trip per command.
+ * Otherwise they are sent one at a time.
+ *
+ * Each command must be a single SQL statement, and is run as if it
+ * were sent alone: a failed command does not affect the others, except
+ * that later commands in the same explicit transaction block are not
+ * run.  Rows returned by commands are discarded.  Commands that cannot
+ * run in a transaction block, such as VACUUM, should not be queued.
+ *
+ * The queue is cleared by execute() even if it throws an exception.
+ * After an exception, any remaining results have been discarded and
+ * the connection has been taken out of pipeline mode if possible.
+ */
+class pgconn_batch {
+public:
+    pgconn_batch(pgconn* postgres);
+    void add(const string& command);
+    size_t size() const;
+    void execute();
+    void execute(vector<string>* errors);
+private:
+    pgconn* postgres;
+    vector<string> commands;
+};
+
 class pgconn_result_async {
 public:
     PGresult* result;
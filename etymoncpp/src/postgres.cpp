@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <new>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "../include/postgres.h"
 
@@ -9,6 +13,25 @@ static void debug_notice_processor(void *arg, const char *message)
     // NOP
 }
 
+/**
+ * \brief Returns the counter of connections opened.
+ *
+ * The counter is kept in memory shared with child processes, so that
+ * it includes connections opened after fork().  It is created by the
+ * first connection, which should be opened before any fork().
+ */
+static atomic<size_t>* open_counter()
+{
+    static atomic<size_t>* counter = [] {
+        void* p = mmap(nullptr, sizeof(atomic<size_t>), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return new atomic<size_t>(0);
+        return new (p) atomic<size_t>(0);
+    }();
+    return counter;
+}
+
 pgconn::pgconn(const pgconn_info& info)
 {
     string conninfo = "host=" + info.dbhost + " port=" + to_string(info.dbport) + " user=" + info.dbuser +
@@ -21,6 +44,7 @@ pgconn::pgconn(const pgconn_info& info)
         throw runtime_error(err);
     }
     PQsetNoticeProcessor(conn, debug_notice_processor, (void*) nullptr);
+    (*open_counter())++;
 }
 
 pgconn::~pgconn()
@@ -28,6 +52,113 @@ pgconn::~pgconn()
     PQfinish(conn);
 }
 
+/**
+ * \brief Returns the number of connections opened by this process and
+ * its child processes.
+ */
+size_t pgconn::opened()
+{
+    return *open_counter();
+}
+
+pgconn_pool::pgconn_pool(const pgconn_info& info, size_t max_idle) :
+    info(info), max_idle(max_idle), owner(getpid()) {}
+
+pgconn_pool::~pgconn_pool()
+{
+    // Connections inherited from a parent process belong to the parent.
+    if (getpid() != owner)
+        return;
+    for (auto c : idle)
+        delete c;
+}
+
+pgconn* pgconn_pool::acquire()
+{
+    if (getpid() != owner)
+        return new pgconn(info);
+    while (true) {
+        pgconn* c;
+        {
+            lock_guard<mutex> lock(idle_mutex);
+            if (idle.empty())
+                break;
+            c = idle.back();
+            idle.pop_back();
+        }
+        if (check(c)) {
+            reuse_count++;
+            return c;
+        }
+        discard_count++;
+        delete c;
+    }
+    pgconn* c = new pgconn(info);
+    open_count++;
+    return c;
+}
+
+void pgconn_pool::release(pgconn* conn)
+{
+    if (getpid() != owner) {
+        delete conn;
+        return;
+    }
+    if (check(conn)) {
+        lock_guard<mutex> lock(idle_mutex);
+        if (idle.size() < max_idle) {
+            idle.push_back(conn);
+            return;
+        }
+    } else {
+        discard_count++;
+    }
+    delete conn;
+}
+
+/**
+ * \brief Checks that a connection can be reused: it has not been closed
+ * by the server, is not in a transaction, and is not in pipeline mode.
+ */
+bool pgconn_pool::check(pgconn* conn)
+{
+    // Reading any pending input detects a connection closed by the
+    // server without blocking.
+    if (PQconsumeInput(conn->conn) == 0)
+        return false;
+#ifdef LIBPQ_HAS_PIPELINING
+    if (PQpipelineStatus(conn->conn) != PQ_PIPELINE_OFF)
+        return false;
+#endif
+    return PQstatus(conn->conn) == CONNECTION_OK &&
+        PQtransactionStatus(conn->conn) == PQTRANS_IDLE;
+}
+
+size_t pgconn_pool::opened() const
+{
+    return open_count;
+}
+
+size_t pgconn_pool::reused() const
+{
+    return reuse_count;
+}
+
+size_t pgconn_pool::discarded() const
+{
+    return discard_count;
+}
+
+pgconn_lease::pgconn_lease(pgconn_pool* pool) : pool(pool)
+{
+    conn = pool->acquire();
+}
+
+pgconn_lease::~pgconn_lease()
+{
+    pool->release(conn);
+}
+
 pgconn_result::pgconn_result(pgconn* postgres, const string& command)
 {
     result = PQexec(postgres->conn, command.c_str());
@@ -44,6 +175,147 @@ pgconn_result::~pgconn_result()
     PQclear(result);
 }
 
+pgconn_batch::pgconn_batch(pgconn* postgres)
+{
+    this->postgres = postgres;
+}
+
+void pgconn_batch::add(const string& command)
+{
+    commands.push_back(command);
+}
+
+size_t pgconn_batch::size() const
+{
+    return commands.size();
+}
+
+/**
+ * \brief Sends all queued commands, and throws an exception with the
+ * error message of the first command that failed.
+ */
+void pgconn_batch::execute()
+{
+    vector<string> errors;
+    execute(&errors);
+    for (auto& err : errors) {
+        if (err != "")
+            throw runtime_error(err);
+    }
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// Maximum number of commands sent before their results are read, to
+// keep the server from blocking on a full output buffer.
+static const size_t pipeline_chunk = 256;
+
+/**
+ * \brief Reads and discards any remaining results and leaves pipeline
+ * mode, after an error.
+ *
+ * The connection is left out of pipeline mode if possible; otherwise
+ * it is not in a usable state and should be closed.
+ */
+static void abort_pipeline(PGconn* c)
+{
+    if (PQpipelineStatus(c) == PQ_PIPELINE_OFF)
+        return;
+    // A sync point ends any commands that were sent without one.
+    PQpipelineSync(c);
+    PQflush(c);
+    // Results are read until the last sync point, at which the
+    // pipeline is empty.
+    int idle = 0;
+    while (idle < 2 && PQstatus(c) == CONNECTION_OK) {
+        PGresult* result = PQgetResult(c);
+        if (result == nullptr) {
+            idle++;
+        } else {
+            idle = 0;
+            PQclear(result);
+        }
+        if (PQexitPipelineMode(c) == 1)
+            return;
+    }
+}
+
+/**
+ * \brief Sends commands in pipeline mode and reads their results.
+ */
+static void send_pipeline(PGconn* c, const vector<string>& commands,
+                          vector<string>* errors)
+{
+    for (size_t start = 0; start < commands.size(); start += pipeline_chunk) {
+        size_t end = min(commands.size(), start + pipeline_chunk);
+        // A sync point after each command ends its implicit transaction,
+        // so that an error does not abort the commands that follow.
+        for (size_t x = start; x < end; x++) {
+            if (PQsendQueryParams(c, commands[x].c_str(), 0, nullptr, nullptr,
+                                  nullptr, nullptr, 0) != 1 ||
+                    PQpipelineSync(c) != 1)
+                throw runtime_error(PQerrorMessage(c));
+        }
+        for (size_t x = start; x < end; x++) {
+            PGresult* result;
+            while ( (result = PQgetResult(c)) != nullptr) {
+                if (PQresultStatus(result) == PGRES_FATAL_ERROR &&
+                        (*errors)[x] == "")
+                    (*errors)[x] = PQresultErrorMessage(result);
+                PQclear(result);
+            }
+            result = PQgetResult(c);
+            if (result == nullptr ||
+                    PQresultStatus(result) != PGRES_PIPELINE_SYNC) {
+                string err = PQerrorMessage(c);
+                if (result != nullptr)
+                    PQclear(result);
+                throw runtime_error("pipeline synchronization failed: " +
+                                    err);
+            }
+            PQclear(result);
+        }
+    }
+}
+#endif
+
+/**
+ * \brief Sends all queued commands and clears the queue.
+ *
+ * \param[out] errors Error message for each command in the order
+ * queued, or an empty string if the command succeeded.
+ */
+void pgconn_batch::execute(vector<string>* errors)
+{
+    errors->assign(commands.size(), "");
+    // The queue is cleared even if an exception is thrown.
+    vector<string> commands;
+    commands.swap(this->commands);
+#ifdef LIBPQ_HAS_PIPELINING
+    PGconn* c = postgres->conn;
+    if (PQenterPipelineMode(c) != 1)
+        throw runtime_error(PQerrorMessage(c));
+    try {
+        send_pipeline(c, commands, errors);
+        if (PQexitPipelineMode(c) != 1)
+            throw runtime_error(PQerrorMessage(c));
+    } catch (runtime_error& e) {
+        abort_pipeline(c);
+        throw;
+    }
+#else
+    for (size_t x = 0; x < commands.size(); x++) {
+        PGresult* result = PQexec(postgres->conn, commands[x].c_str());
+        if (result == nullptr) {
+            (*errors)[x] = PQerrorMessage(postgres->conn);
+            continue;
+        }
+        if (PQresultStatus(result) == PGRES_FATAL_ERROR)
+            (*errors)[x] = PQresultErrorMessage(result);
+        PQclear(result);
+    }
+#endif
+}
+
 pgconn_result_async::pgconn_result_async(pgconn* postgres)
 {
     result = PQgetResult(postgres->conn);
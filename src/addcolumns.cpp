@@ -60,7 +60,8 @@ bool valid_ident(const string& s, bool allow_paren)
     return true;
 }
 
-void add_columns(const ldp_options& opt, ldp_log* lg, etymon::pgconn* conn)
+void add_columns(const ldp_options& opt, ldp_log* lg, etymon::pgconn* conn,
+                 const set<string>* tables)
 {
     string filename;
     get_add_column_filename(opt, &filename);
@@ -105,6 +106,8 @@ void add_columns(const ldp_options& opt, ldp_log* lg, etymon::pgconn* conn)
         if (!valid_ident(table, false))
             throw runtime_error(string("adding column: invalid character in \"") + table + "\"");
         transform(table.begin(), table.end(), table.begin(), [](unsigned char c){ return tolower(c); });
+        if (tables != nullptr && tables->find(table) == tables->end())
+            continue;
         string column = split_dot[1];
         if (!valid_ident(column, false))
             throw runtime_error(string("adding column: invalid character in \"") + column + "\"");
@@ -118,9 +121,16 @@ void add_columns(const ldp_options& opt, ldp_log* lg, etymon::pgconn* conn)
     }
 }
 
-void add_optional_columns(const ldp_options& opt, ldp_log* lg)
+/**
+ * \brief Adds the columns listed in ldp_add_column.conf.
+ *
+ * \param[in] tables If not null, only columns of these tables are
+ * added.
+ */
+void add_optional_columns(const ldp_options& opt, ldp_log* lg,
+                          const set<string>* tables)
 {
     etymon::pgconn conn(opt.dbinfo);
-    add_columns(opt, lg, &conn);
+    add_columns(opt, lg, &conn, tables);
 }
 
@@ -1,9 +1,12 @@
 #ifndef LDP_ADDCOLUMNS_H
 #define LDP_ADDCOLUMNS_H
 
+#include <set>
+
 #include "options.h"
 
-void add_optional_columns(const ldp_options& opt, ldp_log* lg);
+void add_optional_columns(const ldp_options& opt, ldp_log* lg,
+                          const set<string>* tables);
 
 #endif
 
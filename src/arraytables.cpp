@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "arraytables.h"
+#include "camelcase.h"
+
+namespace fs = std::filesystem;
+
+void get_array_table_filename(const ldp_options& opt, string* filename)
+{
+    fs::path datadir = opt.datadir;
+    fs::path array_table = datadir / "ldp_array_table.conf";
+    *filename = array_table;
+}
+
+// Converts an array path such as "/holdingsStatements" to a child table
+// name such as "inventory_holdings__holdings_statements".
+static void array_table_name(const string& table, const string& path,
+                             string* name)
+{
+    *name = table;
+    stringstream ss(path.substr(1));
+    string token;
+    while (getline(ss, token, '/')) {
+        if (token == "")
+            throw runtime_error("array table list: empty field name in path: " + path);
+        for (auto c : token) {
+            if (!isalnum(c) && c != '_')
+                throw runtime_error("array table list: invalid character in path: " + path);
+        }
+        string decoded;
+        decode_camel_case(token.c_str(), &decoded);
+        *name += "__" + decoded;
+    }
+    // The loading table name adds a prefix of 4 characters.
+    if (name->length() > 59)
+        throw runtime_error("array table list: table name too long: " + *name);
+}
+
+void read_array_tables(const ldp_options& opt, ldp_log* lg, ldp_schema* schema)
+{
+    string filename;
+    get_array_table_filename(opt, &filename);
+    if ( !(fs::exists(filename)) ) {
+        return;
+    }
+    ifstream infile(filename);
+    string line;
+    while (getline(infile, line)) {
+        etymon::trim(&line);
+        if (line == "")
+            continue;
+        // Parse table and array path
+        vector<string> split_space;
+        stringstream ss_space(line);
+        string split_space_token;
+        while (getline(ss_space, split_space_token, ' ')) {
+            etymon::trim(&split_space_token);
+            if (split_space_token != "")
+                split_space.push_back(split_space_token);
+        }
+        if (split_space.size() != 2 || split_space[1][0] != '/')
+            throw runtime_error(string("array table list: parsing error: ") + line);
+        string table = split_space[0];
+        transform(table.begin(), table.end(), table.begin(), [](unsigned char c){ return tolower(c); });
+        array_table_schema array;
+        array.path = split_space[1];
+        array_table_name(table, array.path, &array.name);
+        bool found = false;
+        for (auto& t : schema->tables) {
+            if (t.name == table) {
+                t.arrays.push_back(array);
+                found = true;
+            }
+        }
+        if (!found)
+            lg->warning("array table list: unknown table: " + table);
+        else
+            lg->trace(table + ": extracting array " + array.path + " to " + array.name);
+    }
+}
+
@@ -0,0 +1,10 @@
+#ifndef LDP_ARRAYTABLES_H
+#define LDP_ARRAYTABLES_H
+
+#include "options.h"
+#include "schema.h"
+
+void read_array_tables(const ldp_options& opt, ldp_log* lg, ldp_schema* schema);
+
+#endif
+
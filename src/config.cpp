@@ -93,6 +93,22 @@ bool ldp_config::get_int(const string& key, bool required,
     return true;
 }
 
+bool ldp_config::get_double(const string& key, bool required,
+                            double* value) const
+{
+    const json::Value* v = get_json_pointer(key);
+    if (v == nullptr) {
+        if (required)
+            throw_required_value_not_found(key);
+        else
+            return false;
+    }
+    if (v->IsNumber() == false)
+        throw_invalid_data_type(key, "number");
+    *value = v->GetDouble();
+    return true;
+}
+
 void ldp_config::get_enable_sources(vector<data_source>* enable_sources) const
 {
     enable_sources->clear();
@@ -13,6 +13,7 @@ public:
     void get_enable_sources(vector<data_source>* enable_sources) const;
     bool get_string(const string& key, bool required, string* value) const;
     bool get_int(const string& key, bool required, int* value) const;
+    bool get_double(const string& key, bool required, double* value) const;
     ///////////////////////////////////////////////////////////////////////////
     bool get(const string& key, string* value) const;
     bool old_get_int(const string& key, int* value) const;
@@ -1644,3 +1644,198 @@ void database_upgrade_35(database_upgrade_options* opt)
     { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
     ulog_commit(opt);
 }
+
+void database_upgrade_36(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbsystem.update_progress (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    phase VARCHAR(15) NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.update_progress TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.update_progress TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 36;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
+
+void database_upgrade_37(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbconfig.update_schedule (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    enable_update BOOLEAN NOT NULL DEFAULT TRUE,\n"
+        "    update_interval INTERVAL NOT NULL\n"
+        "        CHECK (update_interval > INTERVAL '0'),\n"
+        "    next_update TIMESTAMP WITH TIME ZONE NOT NULL\n"
+        "        DEFAULT CURRENT_TIMESTAMP,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbconfig.update_schedule TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT, INSERT, UPDATE, DELETE ON dbconfig.update_schedule TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 37;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
+
+void database_upgrade_38(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbsystem.column_stats (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    column_name VARCHAR(63) NOT NULL,\n"
+        "    distinct_count BIGINT NOT NULL,\n"
+        "    null_ratio REAL NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name, column_name)\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.column_stats TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.column_stats TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 38;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
+
+void database_upgrade_39(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbsystem.table_schemas (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    fingerprint VARCHAR(63) NOT NULL,\n"
+        "    columns TEXT NOT NULL,\n"
+        "    row_count BIGINT NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.table_schemas TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.table_schemas TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 39;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
+
+void database_upgrade_40(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbconfig.data_indexes (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    enable_index BOOLEAN NOT NULL DEFAULT TRUE,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbconfig.data_indexes TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT, INSERT, UPDATE, DELETE ON dbconfig.data_indexes TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql =
+        "ALTER TABLE dbsystem.tables\n"
+        "    ADD COLUMN data_index_time REAL,\n"
+        "    ADD COLUMN data_index_size BIGINT;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 40;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
+
+void database_upgrade_41(database_upgrade_options* opt)
+{
+    { etymon::pgconn_result r(opt->conn, "BEGIN;"); }
+
+    string sql =
+        "CREATE TABLE dbsystem.table_metrics (\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    phase VARCHAR(15) NOT NULL,\n"
+        "    wall_time REAL NOT NULL,\n"
+        "    cpu_time REAL NOT NULL,\n"
+        "    row_count BIGINT,\n"
+        "    byte_count BIGINT,\n"
+        "    peak_rss BIGINT NOT NULL\n"
+        ");";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "CREATE INDEX ON dbsystem.table_metrics (table_name, updated);";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.table_metrics TO " + opt->ldp_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.table_metrics TO " + opt->ldpconfig_user + ";";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    sql = "UPDATE dbsystem.main SET database_version = 41;";
+    ulog_sql(sql, opt);
+    { etymon::pgconn_result r(opt->conn, sql); }
+
+    { etymon::pgconn_result r(opt->conn, "COMMIT;"); }
+    ulog_commit(opt);
+}
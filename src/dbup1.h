@@ -38,6 +38,12 @@ void database_upgrade_32(database_upgrade_options* opt);
 void database_upgrade_33(database_upgrade_options* opt);
 void database_upgrade_34(database_upgrade_options* opt);
 void database_upgrade_35(database_upgrade_options* opt);
+void database_upgrade_36(database_upgrade_options* opt);
+void database_upgrade_37(database_upgrade_options* opt);
+void database_upgrade_38(database_upgrade_options* opt);
+void database_upgrade_39(database_upgrade_options* opt);
+void database_upgrade_40(database_upgrade_options* opt);
+void database_upgrade_41(database_upgrade_options* opt);
 
 void ulog_sql(const string& sql, database_upgrade_options* opt);
 void ulog_commit(database_upgrade_options* opt);
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "flattenfields.h"
+
+namespace fs = std::filesystem;
+
+void get_flatten_field_filename(const ldp_options& opt, string* filename)
+{
+    fs::path datadir = opt.datadir;
+    fs::path flatten_field = datadir / "ldp_flatten_field.conf";
+    *filename = flatten_field;
+}
+
+void read_flatten_fields(const ldp_options& opt, ldp_log* lg, ldp_schema* schema)
+{
+    string filename;
+    get_flatten_field_filename(opt, &filename);
+    if ( !(fs::exists(filename)) ) {
+        return;
+    }
+    ifstream infile(filename);
+    string line;
+    while (getline(infile, line)) {
+        etymon::trim(&line);
+        if (line == "")
+            continue;
+        // Parse table and field
+        vector<string> split_space;
+        stringstream ss_space(line);
+        string split_space_token;
+        while (getline(ss_space, split_space_token, ' ')) {
+            etymon::trim(&split_space_token);
+            if (split_space_token != "")
+                split_space.push_back(split_space_token);
+        }
+        if (split_space.size() != 2 || split_space[1].length() < 2 ||
+                split_space[1][0] != '/' || split_space[1].back() == '/')
+            throw runtime_error(string("flatten field list: parsing error: ") + line);
+        string table = split_space[0];
+        string field = split_space[1];
+        transform(table.begin(), table.end(), table.begin(), [](unsigned char c){ return tolower(c); });
+        bool found = false;
+        for (auto& t : schema->tables) {
+            if (t.name == table) {
+                t.flatten_paths.push_back(field);
+                found = true;
+            }
+        }
+        if (!found)
+            lg->warning("flatten field list: unknown table: " + table);
+    }
+}
+
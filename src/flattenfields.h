@@ -0,0 +1,10 @@
+#ifndef LDP_FLATTENFIELDS_H
+#define LDP_FLATTENFIELDS_H
+
+#include "options.h"
+#include "schema.h"
+
+void read_flatten_fields(const ldp_options& opt, ldp_log* lg, ldp_schema* schema);
+
+#endif
+
@@ -0,0 +1,179 @@
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include "../etymoncpp/include/util.h"
+#include "idfilter.h"
+
+namespace fs = std::filesystem;
+
+// Bits per id and number of hash functions, for a false positive rate
+// of about 1%.
+static const size_t filter_bits_per_id = 10;
+static const int filter_hashes = 7;
+
+// Number of values sampled per column.
+static const size_t reference_sample_size = 256;
+
+static void hash_id(const char* id, uint64_t* h1, uint64_t* h2)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (const char* p = id; *p != '\0'; p++) {
+        h ^= (unsigned char) tolower(*p);
+        h *= 1099511628211ULL;
+    }
+    *h1 = h;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    *h2 = h | 1;
+}
+
+// A filter holds at least one word, so that ids can be added to and
+// looked up in a filter that was built for no ids.
+id_filter::id_filter()
+{
+    init(0);
+}
+
+void id_filter::init(size_t expected_count)
+{
+    size_t words = (expected_count * filter_bits_per_id + 63) / 64;
+    bits.assign(words < 1 ? 1 : words, 0);
+}
+
+void id_filter::add(const char* id)
+{
+    uint64_t h1, h2;
+    hash_id(id, &h1, &h2);
+    uint64_t nbits = bits.size() * 64;
+    for (int x = 0; x < filter_hashes; x++) {
+        uint64_t b = (h1 + x * h2) % nbits;
+        bits[b / 64] |= (uint64_t) 1 << (b % 64);
+    }
+}
+
+bool id_filter::may_contain(const string& id) const
+{
+    uint64_t h1, h2;
+    hash_id(id.c_str(), &h1, &h2);
+    uint64_t nbits = bits.size() * 64;
+    for (int x = 0; x < filter_hashes; x++) {
+        uint64_t b = (h1 + x * h2) % nbits;
+        if ((bits[b / 64] & ((uint64_t) 1 << (b % 64))) == 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Returns a pseudorandom number in [0, n), from a splitmix64
+ * sequence, so that samples are reproducible.
+ */
+uint64_t id_summary::random(uint64_t n)
+{
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+    return z % n;
+}
+
+/**
+ * \brief Adds a value of a column to the sample of the column's
+ * values.
+ *
+ * Reservoir sampling keeps each value seen with equal probability.
+ */
+void id_summary::add_reference(const string& column, const char* value)
+{
+    vector<string>& values = references[column];
+    uint64_t n = ++seen[column];
+    size_t x;
+    if (values.size() < reference_sample_size) {
+        x = values.size();
+        values.push_back("");
+    } else {
+        uint64_t r = random(n);
+        if (r >= reference_sample_size)
+            return;
+        x = r;
+    }
+    values[x] = value;
+    etymon::to_lower(&(values[x]));
+}
+
+/**
+ * \brief Writes the summary to a file.
+ *
+ * The file contains a line giving the number of 64-bit words in the
+ * filter and the number of columns; for each column, a line giving its
+ * name and number of sampled values followed by one value per line; and
+ * finally the filter words in native byte order.
+ */
+void id_summary::write(const string& filename) const
+{
+    etymon::file f(filename, "w");
+    fprintf(f.fp, "%zu %zu\n", ids.bits.size(), references.size());
+    for (auto& [column, sample] : references) {
+        set<string> values(sample.begin(), sample.end());
+        fprintf(f.fp, "%s %zu\n", column.c_str(), values.size());
+        for (auto& v : values)
+            fprintf(f.fp, "%s\n", v.c_str());
+    }
+    if (fwrite(ids.bits.data(), sizeof(uint64_t), ids.bits.size(), f.fp) !=
+            ids.bits.size())
+        throw runtime_error("error writing file: " + filename);
+}
+
+/**
+ * \brief Reads a summary written by write().
+ *
+ * \retval true The summary was read.
+ * \retval false The file does not exist or is incomplete.
+ */
+bool id_summary::read(const string& filename)
+{
+    if (!fs::exists(filename))
+        return false;
+    etymon::file f(filename, "r");
+    // Lines are read with fgets() so that no bytes of the filter, which
+    // follows them, are consumed.
+    char line[512];
+    size_t words, columns;
+    if (fgets(line, sizeof line, f.fp) == nullptr ||
+            sscanf(line, "%zu %zu", &words, &columns) != 2 || words == 0)
+        return false;
+    references.clear();
+    seen.clear();
+    char name[256];
+    for (size_t c = 0; c < columns; c++) {
+        size_t count;
+        if (fgets(line, sizeof line, f.fp) == nullptr ||
+                sscanf(line, "%255s %zu", name, &count) != 2)
+            return false;
+        vector<string>& values = references[name];
+        for (size_t v = 0; v < count; v++) {
+            if (fgets(line, sizeof line, f.fp) == nullptr)
+                return false;
+            line[strcspn(line, "\n")] = '\0';
+            values.push_back(line);
+        }
+    }
+    ids.bits.assign(words, 0);
+    return fread(ids.bits.data(), sizeof(uint64_t), words, f.fp) == words;
+}
+
+void id_summary_dir(const ldp_options& opt, string* dir)
+{
+    fs::path datadir = opt.datadir;
+    *dir = datadir / "tmp" / "ids";
+}
+
+void id_summary_path(const string& dir, const string& table, string* path)
+{
+    *path = dir;
+    etymon::join(path, table + "_ids.dat");
+}
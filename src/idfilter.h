@@ -0,0 +1,61 @@
+#ifndef LDP_IDFILTER_H
+#define LDP_IDFILTER_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+using namespace std;
+
+/**
+ * \brief Bloom filter of record ids.
+ *
+ * A filter may report that it contains an id that was never added, but
+ * never reports that an added id is missing.  Ids are compared without
+ * regard to case.
+ */
+class id_filter {
+public:
+    id_filter();
+    void init(size_t expected_count);
+    void add(const char* id);
+    bool may_contain(const string& id) const;
+    vector<uint64_t> bits;
+};
+
+/**
+ * \brief Ids of the records in a staged table, with a sample of the
+ * values in each of its columns of type id.
+ *
+ * Summaries are written during staging and read during foreign key
+ * detection, so that most candidate references can be ruled out without
+ * querying the database.  The sampled values identify the columns of
+ * type id and are reported in the log; references are decided using
+ * all values of a column.  The values of each column are sampled
+ * uniformly from all of its values, so that the sample does not depend
+ * on the order of the records.
+ */
+class id_summary {
+public:
+    id_filter ids;
+    // Sampled values by column, which may include duplicates while
+    // staging.
+    map<string,vector<string>> references;
+    void add_reference(const string& column, const char* value);
+    void write(const string& filename) const;
+    bool read(const string& filename);
+private:
+    // Number of values seen by column.
+    map<string,uint64_t> seen;
+    uint64_t random_state = 0x9e3779b97f4a7c15;
+    uint64_t random(uint64_t n);
+};
+
+void id_summary_dir(const ldp_options& opt, string* dir);
+void id_summary_path(const string& dir, const string& table, string* path);
+
+#endif
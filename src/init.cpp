@@ -12,7 +12,7 @@
 
 namespace fs = std::filesystem;
 
-static int64_t ldp_latest_database_version = 35;
+static int64_t ldp_latest_database_version = 41;
 
 database_upgrade_array database_upgrades[] = {
     nullptr,  // Version 0 has no migration.
@@ -50,7 +50,13 @@ database_upgrade_array database_upgrades[] = {
     database_upgrade_32,
     database_upgrade_33,
     database_upgrade_34,
-    database_upgrade_35
+    database_upgrade_35,
+    database_upgrade_36,
+    database_upgrade_37,
+    database_upgrade_38,
+    database_upgrade_39,
+    database_upgrade_40,
+    database_upgrade_41
 };
 
 int64_t latest_database_version()
@@ -193,14 +199,18 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
         "    row_count BIGINT,\n"
         "    history_row_count BIGINT,\n"
         "    documentation VARCHAR(65535),\n"
-        "    documentation_url VARCHAR(65535)\n"
+        "    documentation_url VARCHAR(65535),\n"
+        "    data_index_time REAL,\n"
+        "    data_index_size BIGINT\n"
         ");";
     { etymon::pgconn_result r(conn, sql); }
     // Add tables to the catalog.
+    etymon::pgconn_batch batch(conn);
     for (auto& table : schema.tables) {
         add_table_to_catalog_sql(conn, table.name, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
     }
+    batch.execute();
 
     string rskeys;
     dbt.redshift_keys("referencing_table",
@@ -228,6 +238,52 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
         ")" + rskeys + ";";
     { etymon::pgconn_result r(conn, sql); }
 
+    sql =
+        "CREATE TABLE dbsystem.update_progress (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    phase VARCHAR(15) NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql =
+        "CREATE TABLE dbsystem.column_stats (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    column_name VARCHAR(63) NOT NULL,\n"
+        "    distinct_count BIGINT NOT NULL,\n"
+        "    null_ratio REAL NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name, column_name)\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql =
+        "CREATE TABLE dbsystem.table_schemas (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    fingerprint VARCHAR(63) NOT NULL,\n"
+        "    columns TEXT NOT NULL,\n"
+        "    row_count BIGINT NOT NULL,\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql =
+        "CREATE TABLE dbsystem.table_metrics (\n"
+        "    updated TIMESTAMP WITH TIME ZONE NOT NULL,\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    phase VARCHAR(15) NOT NULL,\n"
+        "    wall_time REAL NOT NULL,\n"
+        "    cpu_time REAL NOT NULL,\n"
+        "    row_count BIGINT,\n"
+        "    byte_count BIGINT,\n"
+        "    peak_rss BIGINT NOT NULL\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "CREATE INDEX ON dbsystem.table_metrics (table_name, updated);";
+    { etymon::pgconn_result r(conn, sql); }
+
     //sql = "GRANT SELECT ON ALL TABLES IN SCHEMA dbsystem TO " + ldp_user + ";";
     //{ etymon::pgconn_result r(conn, sql); }
     //sql = "GRANT SELECT ON ALL TABLES IN SCHEMA dbsystem TO " +
@@ -258,6 +314,27 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
     sql = "GRANT SELECT ON dbsystem.tables TO " + ldpconfig_user + ";";
     { etymon::pgconn_result r(conn, sql); }
 
+    sql = "GRANT SELECT ON dbsystem.update_progress TO " + ldp_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.update_progress TO " + ldpconfig_user +
+        ";";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.column_stats TO " + ldp_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.column_stats TO " + ldpconfig_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.table_schemas TO " + ldp_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.table_schemas TO " + ldpconfig_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql = "GRANT SELECT ON dbsystem.table_metrics TO " + ldp_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT SELECT ON dbsystem.table_metrics TO " + ldpconfig_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+
     // Schema: dbconfig
 
     sql = "CREATE SCHEMA dbconfig;";
@@ -304,6 +381,26 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
         ");";
     { etymon::pgconn_result r(conn, sql); }
 
+    sql =
+        "CREATE TABLE dbconfig.update_schedule (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    enable_update BOOLEAN NOT NULL DEFAULT TRUE,\n"
+        "    update_interval INTERVAL NOT NULL\n"
+        "        CHECK (update_interval > INTERVAL '0'),\n"
+        "    next_update TIMESTAMP WITH TIME ZONE NOT NULL\n"
+        "        DEFAULT CURRENT_TIMESTAMP,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+
+    sql =
+        "CREATE TABLE dbconfig.data_indexes (\n"
+        "    table_name VARCHAR(63) NOT NULL,\n"
+        "    enable_index BOOLEAN NOT NULL DEFAULT TRUE,\n"
+        "        PRIMARY KEY (table_name)\n"
+        ");";
+    { etymon::pgconn_result r(conn, sql); }
+
     sql = "GRANT SELECT ON ALL TABLES IN SCHEMA dbconfig TO " + ldp_user + ";";
     { etymon::pgconn_result r(conn, sql); }
     sql = "GRANT SELECT ON ALL TABLES IN SCHEMA dbconfig TO " + ldpconfig_user +
@@ -311,6 +408,12 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
     { etymon::pgconn_result r(conn, sql); }
     sql = "GRANT UPDATE ON dbconfig.general TO " + ldpconfig_user + ";";
     { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT INSERT, UPDATE, DELETE ON dbconfig.update_schedule TO " +
+        ldpconfig_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
+    sql = "GRANT INSERT, UPDATE, DELETE ON dbconfig.data_indexes TO " +
+        ldpconfig_user + ";";
+    { etymon::pgconn_result r(conn, sql); }
 
     // Schema: history
 
@@ -324,27 +427,29 @@ static void init_database_all(etymon::pgconn* conn, const string& ldp_user,
 
     for (auto& table : schema.tables) {
         create_history_table_sql(table.name, conn, dbt, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
         grant_select_on_table_sql("history." + table.name, ldp_user,
                                   conn, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
         grant_select_on_table_sql("history." + table.name, ldpconfig_user,
                                   conn, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
     }
+    batch.execute();
 
     // Schema: public
 
     for (auto& table : schema.tables) {
         create_main_table_sql(table.name, conn, dbt, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
         comment_sql(table.name, table.module_name, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
         grant_select_on_table_sql(table.name, ldp_user, conn, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
         grant_select_on_table_sql(table.name, ldpconfig_user, conn, &sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
     }
+    batch.execute();
 
     // Schema: local
 
@@ -20,6 +20,9 @@
 #include "init.h"
 #include "ldp.h"
 #include "log.h"
+#include "metricsfile.h"
+#include "notify.h"
+#include "schedule.h"
 #include "schema.h"
 #include "timer.h"
 #include "update.h"
@@ -213,6 +216,40 @@ static void set_dbsystem_main_anonymize(const ldp_options& opt)
     { etymon::pgconn_result r(&conn, sql); }
 }
 
+static void start_update(const ldp_options& opt, bool update_users,
+                         ldp_log* lg)
+{
+    if (!opt.single_process && !update_users) {  // forked process
+        pid_t pid = fork();
+        if (pid == 0)
+            run_update_process(opt);
+        if (pid > 0) {
+            int stat;
+            waitpid(pid, &stat, 0);
+            if (WIFEXITED(stat))
+                lg->write(log_level::trace, "", "",
+                          "Status code of full update: " +
+                          to_string(WEXITSTATUS(stat)), -1);
+            else
+                lg->write(log_level::trace, "", "",
+                          "Full update did not terminate normally", -1);
+        }
+        if (pid < 0)
+            throw runtime_error("Error starting child process");
+    } else {  // single process
+        try {
+            run_update(opt, update_users);
+        } catch (runtime_error& e) {
+            string s = e.what();
+            if ( !(s.empty()) && s.back() == '\n' )
+                s.pop_back();
+            etymon::pgconn log_conn(opt.dbinfo);
+            ldp_log lg(&log_conn, opt.lg_level, opt.console, opt.quiet);
+            lg.write(log_level::error, "server", "", s, -1);
+        }
+    }
+}
+
 void server_loop(const ldp_options& opt, bool update_users)
 {
     // Check that database version is up to date.
@@ -231,43 +268,59 @@ void server_loop(const ldp_options& opt, bool update_users)
     etymon::pgconn conn(opt.dbinfo);
     dbtype dbt(&conn);
 
+    ldp_schema schema;
+    ldp_schema::make_default_schema(&schema);
+
+    // Tables can be updated on request by sending their names with NOTIFY.
+    // Requests are collected until they stop arriving for a few seconds (at
+    // most 30 seconds), and then combined with any tables that are due to be updated.
+    set<string> requested_tables;
+    if (!opt.cli_mode)
+        listen_for_update_requests(&conn, &lg);
+
+    // The metrics file is also written by the update process while an
+    // update is running.
+    metrics_file metrics(opt);
+    if (!update_users)
+        metrics.write(&conn, &lg);
+
     do {
         if (opt.cli_mode || time_for_full_update(opt, &conn, &dbt, &lg) ) {
             //if (!opt.cli_mode)
             //    reschedule_next_daily_load(opt, &conn, &dbt, &lg);
-            if (!opt.single_process && !update_users) {  // forked process
-                pid_t pid = fork();
-                if (pid == 0)
-                    run_update_process(opt);
-                if (pid > 0) {
-                    int stat;
-                    waitpid(pid, &stat, 0);
-                    if (WIFEXITED(stat))
-                        lg.write(log_level::trace, "", "",
-                                 "Status code of full update: " +
-                                 to_string(WEXITSTATUS(stat)), -1);
-                    else
-                        lg.write(log_level::trace, "", "",
-                                 "Full update did not terminate normally", -1);
-                }
-                if (pid < 0)
-                    throw runtime_error("Error starting child process");
-            } else {  // single process
-                try {
-                    run_update(opt, update_users);
-                } catch (runtime_error& e) {
-                    string s = e.what();
-                    if ( !(s.empty()) && s.back() == '\n' )
-                        s.pop_back();
-                    etymon::pgconn log_conn(opt.dbinfo);
-                    ldp_log lg(&log_conn, opt.lg_level, opt.console, opt.quiet);
-                    lg.write(log_level::error, "server", "", s, -1);
-                }
+            if (!update_users)
+                metrics.start_update(&conn, &lg);
+            start_update(opt, update_users, &lg);
+            if (!update_users) {
+                metrics.end_update();
+                metrics.write(&conn, &lg);
+            }
+            requested_tables.clear();
+        } else if (!update_users) {
+            // Tables that are due according to their own schedules are
+            // updated together in one run.
+            vector<string> due_tables;
+            select_due_tables(&conn, &lg, schema, &due_tables);
+            for (auto& t : due_tables)
+                requested_tables.insert(t);
+            if (requested_tables.size() > 0) {
+                ldp_options scheduled_opt = opt;
+                scheduled_opt.scheduled_tables.assign(requested_tables.begin(), requested_tables.end());
+                requested_tables.clear();
+                metrics.start_update(&conn, &lg);
+                start_update(scheduled_opt, false, &lg);
+                metrics.end_update();
+                metrics.write(&conn, &lg);
             }
         }
 
-        if (!opt.cli_mode)
-            std::this_thread::sleep_for(std::chrono::seconds(60));
+        if (!opt.cli_mode) {
+            if (wait_for_update_requests(&conn, &lg, schema, 60000, &requested_tables)) {
+                timer coalesce_timer;
+                while (coalesce_timer.elapsed_time() < 30 &&
+                       wait_for_update_requests(&conn, &lg, schema, 3000, &requested_tables)) {}
+            }
+        }
     } while (!opt.cli_mode);
 
     //lg.write(log_level::info, "server", "", string("server stopped"), -1);
@@ -409,12 +462,70 @@ void config_options(const ldp_config& conf, ldp_options* opt)
 
     conf.get_bool("/record_history", &(opt->record_history));
 
+    string loading_mode;
+    if (conf.get("/loading_table_mode", &loading_mode))
+        config_set_loading_table_mode(loading_mode, &(opt->loading_mode));
+
+    conf.get_bool("/keep_unlogged", &(opt->keep_unlogged));
+
     conf.get_bool("/all_indexes", &(opt->all_indexes));
 
+    conf.get_int("/index_workers", false, &(opt->index_workers));
+    if (opt->index_workers < 1)
+        throw_value_out_of_range("/index_workers", to_string(opt->index_workers), "1 or greater");
+
+    conf.get_double("/index_min_selectivity", false, &(opt->index_min_selectivity));
+    if (opt->index_min_selectivity < 0 || opt->index_min_selectivity > 1)
+        throw_value_out_of_range("/index_min_selectivity", to_string(opt->index_min_selectivity), "between 0 and 1");
+
+    conf.get_int("/inference_sample_size", false, &(opt->inference_sample_size));
+    if (opt->inference_sample_size < 0)
+        throw_value_out_of_range("/inference_sample_size", to_string(opt->inference_sample_size), "0 or greater");
+
+    conf.get_int("/flatten_depth", false, &(opt->flatten_depth));
+    if (opt->flatten_depth < 1)
+        throw_value_out_of_range("/flatten_depth", to_string(opt->flatten_depth), "1 or greater");
+
+    conf.get("/maintenance_work_mem", &(opt->maintenance_work_mem));
+    for (auto c : opt->maintenance_work_mem) {
+        if (!isalnum(c) && c != ' ')
+            throw_value_out_of_range("/maintenance_work_mem", opt->maintenance_work_mem, "a memory size such as \"256MB\"");
+    }
+
+    conf.get_int("/max_parallel_maintenance_workers", false, &(opt->max_parallel_maintenance_workers));
+
     conf.get_bool("/parallel_vacuum", &(opt->parallel_vacuum));
 
     conf.get_bool("/parallel_update", &(opt->parallel_update));
 
+    conf.get_int("/update_workers", false, &(opt->update_workers));
+    if (opt->update_workers < 1)
+        throw_value_out_of_range("/update_workers", to_string(opt->update_workers), "1 or greater");
+
+    string update_executor;
+    if (conf.get("/update_executor", &update_executor))
+        config_set_update_executor_mode(update_executor, &(opt->update_executor));
+
+    // Worker processes cannot be forked safely while extraction threads
+    // are running, and so tables are extracted in threads only with the
+    // thread executor.
+    if (!conf.get_int("/extraction_workers", false, &(opt->extraction_workers)))
+        opt->extraction_workers = (opt->update_executor == update_executor_mode::thread ? 2 : 0);
+    if (opt->extraction_workers < 0)
+        throw_value_out_of_range("/extraction_workers", to_string(opt->extraction_workers), "0 or greater");
+    if (opt->update_executor == update_executor_mode::process && opt->parallel_update && opt->extraction_workers > 0)
+        throw_value_out_of_range("/extraction_workers", to_string(opt->extraction_workers), "0 if update_executor is \"process\"");
+
+    conf.get_int("/extraction_disk_limit", false, &(opt->extraction_disk_limit));
+    if (opt->extraction_disk_limit < 0)
+        throw_value_out_of_range("/extraction_disk_limit", to_string(opt->extraction_disk_limit), "0 or greater");
+
+    conf.get_int("/resume_max_age", false, &(opt->resume_max_age));
+    if (opt->resume_max_age < 0)
+        throw_value_out_of_range("/resume_max_age", to_string(opt->resume_max_age), "0 or greater");
+
+    conf.get_bool("/metrics_file", &(opt->metrics_file));
+
     conf.get_bool("/allow_destructive_tests", &(opt->allow_destructive_tests));
 }
 
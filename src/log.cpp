@@ -1,5 +1,7 @@
 #include <cstring>
+#include <ctime>
 #include <stdexcept>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "../etymoncpp/include/util.h"
@@ -15,26 +17,140 @@ void ldp_log::init(log_level lv, bool console, bool quiet)
 
 ldp_log::ldp_log(etymon::pgconn* conn, log_level lv, bool console, bool quiet)
 {
-    this->dbinfo = nullptr;
+    this->pool = nullptr;
     this->conn = conn;
     this->init(lv, console, quiet);
 }
 
-ldp_log::ldp_log(log_level lv, bool console, bool quiet, const etymon::pgconn_info* dbinfo)
+ldp_log::ldp_log(log_level lv, bool console, bool quiet, etymon::pgconn_pool* pool)
 {
-    this->dbinfo = dbinfo;
+    this->pool = pool;
     this->conn = nullptr;
     this->init(lv, console, quiet);
 }
 
 ldp_log::~ldp_log()
 {
+    if (flusher != nullptr && owner == getpid()) {
+        {
+            lock_guard<mutex> lock(write_mutex);
+            stopping = true;
+        }
+        flush_wanted.notify_all();
+        flusher->join();
+        delete flusher;
+    }
+    flush();
     delete dbt;
 }
 
+// Number of buffered records that causes an early flush.
+static const size_t log_flush_records = 500;
+
+// Maximum time in seconds that a record is buffered.
+static const int log_flush_interval = 1;
+
+// Formats the current time as a COPY value with microseconds.
+static void format_log_time(string* log_time)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    struct tm t;
+    gmtime_r(&tv.tv_sec, &t);
+    char buf[64];
+    size_t n = strftime(buf, sizeof buf, "%Y-%m-%d %H:%M:%S", &t);
+    snprintf(buf + n, sizeof buf - n, ".%06ld+00", (long) tv.tv_usec);
+    *log_time = buf;
+}
+
+/**
+ * \brief Takes ownership of the buffer in a new process.
+ *
+ * Records inherited from the parent process across fork() are
+ * discarded, since the parent will insert them, and a flusher thread is
+ * started for this process.  This function must be called with
+ * write_mutex locked.
+ */
+void ldp_log::check_owner()
+{
+    pid_t pid = getpid();
+    if (owner == pid)
+        return;
+    // The flusher thread of the parent process does not exist in a
+    // child process, and its thread object is abandoned.
+    owner = pid;
+    buffer.clear();
+    stopping = false;
+    flusher = new thread(&ldp_log::run_flusher, this);
+}
+
+void ldp_log::run_flusher()
+{
+    unique_lock<mutex> lock(write_mutex);
+    while (!stopping) {
+        flush_wanted.wait_for(lock, chrono::seconds(log_flush_interval), [&] {
+            return stopping || buffer.size() >= log_flush_records;
+        });
+        if (buffer.empty())
+            continue;
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+/**
+ * \brief Inserts all buffered records into dbsystem.log.
+ */
+void ldp_log::flush()
+{
+    if (pool == nullptr)
+        return;
+    // Batches are inserted one at a time to preserve their order.
+    lock_guard<mutex> flock(flush_mutex);
+    vector<string> records;
+    {
+        lock_guard<mutex> lock(write_mutex);
+        if (owner != getpid())
+            return;
+        records.swap(buffer);
+    }
+    if (records.empty())
+        return;
+    string data;
+    for (auto& rec : records)
+        data += rec;
+    try {
+        etymon::pgconn_lease c(pool);
+        {
+            etymon::pgconn_result r(c.conn,
+                    "COPY dbsystem.log\n"
+                    "    (log_time, pid, level, type, table_name, message, elapsed_time)\n"
+                    "    FROM STDIN;");
+        }
+        if (PQputCopyData(c.conn->conn, data.c_str(), data.size()) != 1 ||
+                PQputCopyEnd(c.conn->conn, nullptr) != 1)
+            throw runtime_error(PQerrorMessage(c.conn->conn));
+        PGresult* res = PQgetResult(c.conn->conn);
+        bool ok = (res != nullptr && PQresultStatus(res) == PGRES_COMMAND_OK);
+        string err = ok ? "" : PQresultErrorMessage(res);
+        PQclear(res);
+        while ( (res = PQgetResult(c.conn->conn)) != nullptr)
+            PQclear(res);
+        if (!ok)
+            throw runtime_error(err);
+    } catch (runtime_error& e) {
+        fprintf(stderr, "ldp: error: unable to write to log: %s\n", e.what());
+        fprintf(stderr, "ldp: %zu log records not written:\n%s", records.size(),
+                data.c_str());
+    }
+}
+
 void ldp_log::write(log_level lv, const char* type, const string& table,
         const string& message, double elapsed_time)
 {
+    unique_lock<mutex> lock(write_mutex);
+
     // Add a prefix to highlight error states.
     string logmsg;
     switch (lv) {
@@ -119,22 +235,41 @@ void ldp_log::write(log_level lv, const char* type, const string& table,
     }
 
     // Log the message, and print if the log is not available.
-    string logmsg_encoded;
-    dbt->encode_string_const(logmsg.c_str(), &logmsg_encoded);
-    string sql =
-        "INSERT INTO dbsystem.log\n"
-        "    (log_time, pid, level, type, table_name, message, elapsed_time)\n"
-        "  VALUES\n"
-        "    (" + string(dbt->current_timestamp()) + ", " +
-        to_string(getpid()) + ", '" + level_str + "', '" + type + "', '" +
-        table + "', " + logmsg_encoded + ", " + elapsed_time_str + ");";
-
-    if (conn == nullptr) {
-        etymon::pgconn c(*dbinfo);
-        { etymon::pgconn_result r(&c, sql); }
-    } else {
+    if (conn != nullptr) {
+        string logmsg_encoded;
+        dbt->encode_string_const(logmsg.c_str(), &logmsg_encoded);
+        string sql =
+            "INSERT INTO dbsystem.log\n"
+            "    (log_time, pid, level, type, table_name, message, elapsed_time)\n"
+            "  VALUES\n"
+            "    (" + string(dbt->current_timestamp()) + ", " +
+            to_string(getpid()) + ", '" + level_str + "', '" + type + "', '" +
+            table + "', " + logmsg_encoded + ", " + elapsed_time_str + ");";
         { etymon::pgconn_result r(conn, sql); }
+        return;
     }
+
+    // Without a connection pool the message is only printed.
+    if (pool == nullptr)
+        return;
+
+    // Otherwise buffer the message as a COPY record.
+    check_owner();
+    string log_time, type_encoded, table_encoded, logmsg_encoded;
+    format_log_time(&log_time);
+    dbt->encode_copy(type, &type_encoded);
+    dbt->encode_copy(table.c_str(), &table_encoded);
+    dbt->encode_copy(logmsg.c_str(), &logmsg_encoded);
+    buffer.push_back(log_time + "\t" + to_string(getpid()) + "\t" + level_str +
+                     "\t" + type_encoded + "\t" + table_encoded + "\t" +
+                     logmsg_encoded + "\t" +
+                     (elapsed_time < 0 ? "\\N" : elapsed_time_str) + "\n");
+    bool full = (buffer.size() >= log_flush_records);
+    lock.unlock();
+    if (lv == log_level::error || lv == log_level::fatal)
+        flush();
+    else if (full)
+        flush_wanted.notify_one();
 }
 
 void ldp_log::warning(const string& message)
@@ -157,3 +292,21 @@ void ldp_log::perf(const string& message, double elapsed_time)
     write(log_level::debug, "perf", "", message, elapsed_time);
 }
 
+
+/**
+ * \brief Blocks writes and flushes from other threads.
+ *
+ * The log is locked while forking, so that a child process does not
+ * inherit it in the middle of a write or flush by another thread.
+ */
+void ldp_log::lock()
+{
+    flush_mutex.lock();
+    write_mutex.lock();
+}
+
+void ldp_log::unlock()
+{
+    write_mutex.unlock();
+    flush_mutex.unlock();
+}
@@ -2,7 +2,12 @@
 #define LDP_LOG_H
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #include "../etymoncpp/include/postgres.h"
 #include "dbtype.h"
@@ -19,10 +24,33 @@ enum class log_level {
     detail
 };
 
+/**
+ * \brief Writes messages to the console and to dbsystem.log.
+ *
+ * Messages may be written concurrently from multiple threads; they are
+ * serialized so that console output is not interleaved and a shared
+ * database connection is used by one thread at a time.
+ *
+ * A log created with a connection pool buffers records for dbsystem.log
+ * and inserts them in batches with COPY, from a background thread about
+ * once per second or sooner when many records are waiting.  Records
+ * written by one process are inserted in the order in which they were
+ * written, and log_time is the time of the write rather than of the
+ * insert.  An error or fatal message is inserted, together with all
+ * records written before it, before write() returns.  Remaining records
+ * are inserted by flush() or when the log is destroyed; a process that
+ * exits by other means must call flush() first.  Records from different
+ * processes are not ordered relative to each other except by log_time.
+ * If a batch cannot be inserted, its messages are printed to stderr.
+ *
+ * A log created with a connection inserts each record immediately, and
+ * a log created with neither a connection nor a pool only prints
+ * messages.
+ */
 class ldp_log {
 public:
     ldp_log(etymon::pgconn* conn, log_level lv, bool console, bool quiet);
-    ldp_log(log_level lv, bool console, bool quiet, const etymon::pgconn_info* dbinfo);
+    ldp_log(log_level lv, bool console, bool quiet, etymon::pgconn_pool* pool);
     ~ldp_log();
     void write(log_level lv, const char* type, const string& table,
             const string& message, double elapsed_time);
@@ -30,14 +58,27 @@ public:
     void trace(const string& message);
     void detail(const string& message);
     void perf(const string& message, double elapsed_time);
+    void flush();
+    void lock();
+    void unlock();
 private:
     void init(log_level lv, bool console, bool quiet);
+    void check_owner();
+    void run_flusher();
     log_level lv;
     bool console = false;
     bool quiet = false;
-    const etymon::pgconn_info* dbinfo;
+    etymon::pgconn_pool* pool;
     etymon::pgconn* conn;
     dbtype* dbt;
+    mutex write_mutex;
+    // Buffered records, used only with a connection pool.
+    mutex flush_mutex;
+    condition_variable flush_wanted;
+    vector<string> buffer;
+    thread* flusher = nullptr;
+    bool stopping = false;
+    pid_t owner = 0;
 };
 
 #endif
@@ -1,3 +1,5 @@
+#include <cstdlib>
+
 #include "merge.h"
 #include "names.h"
 #include "util.h"
@@ -58,7 +60,8 @@ void drop_latest_history_table(const ldp_options& opt, ldp_log* lg,
     { etymon::pgconn_result r(conn, sql); }
 }
 
-void merge_table(const ldp_options& opt, ldp_log* lg, const table_schema& table, etymon::pgconn* conn, const dbtype& dbt)
+void merge_table(const ldp_options& opt, ldp_log* lg, const table_schema& table, etymon::pgconn* conn, const dbtype& dbt,
+                 size_t* history_record_count)
 {
     // Update history tables.
 
@@ -85,7 +88,10 @@ void merge_table(const ldp_options& opt, ldp_log* lg, const table_schema& table,
         "          ( h.id IS NULL OR\n"
         "            (s.data)::varchar <> (h.data)::varchar );";
     lg->write(log_level::detail, "", "", sql, -1);
-    { etymon::pgconn_result r(conn, sql); }
+    {
+        etymon::pgconn_result r(conn, sql);
+        *history_record_count = strtoull(PQcmdTuples(r.result), nullptr, 10);
+    }
 }
 
 void drop_table(const ldp_options& opt, ldp_log* lg, const string& tableName,
@@ -106,5 +112,10 @@ void place_table(const ldp_options& opt, ldp_log* lg, const table_schema& table,
         "    RENAME TO " + table.name + ";";
     lg->write(log_level::detail, "", "", sql, -1);
     { etymon::pgconn_result r(conn, sql); }
+    if (opt.loading_mode == loading_table_mode::unlogged && !opt.keep_unlogged) {
+        sql = "ALTER TABLE " + table.name + " SET LOGGED;";
+        lg->write(log_level::detail, "", "", sql, -1);
+        { etymon::pgconn_result r(conn, sql); }
+    }
 }
 
@@ -17,7 +17,8 @@ void drop_latest_history_table(const ldp_options& opt, ldp_log* lg,
                                  etymon::pgconn* conn);
 
 void merge_table(const ldp_options& opt, ldp_log* lg, const table_schema& table,
-                 etymon::pgconn* conn, const dbtype& dbt);
+                 etymon::pgconn* conn, const dbtype& dbt,
+                 size_t* history_record_count);
 void drop_table(const ldp_options& opt, ldp_log* lg, const string& tableName,
                 etymon::pgconn* conn);
 void place_table(const ldp_options& opt, ldp_log* lg, const table_schema& table,
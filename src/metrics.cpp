@@ -0,0 +1,97 @@
+#include <ctime>
+#include <stdexcept>
+#include <sys/resource.h>
+
+#include "metrics.h"
+
+static double thread_cpu_time()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int64_t peak_rss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // Reported in kilobytes on Linux.
+    return int64_t(usage.ru_maxrss) * 1024;
+}
+
+phase_timer::phase_timer()
+{
+    restart();
+}
+
+void phase_timer::restart()
+{
+    wall.restart();
+    cpu_start = thread_cpu_time();
+}
+
+/**
+ * \brief Adds the metrics of a phase that has ended, and starts
+ * measuring the next phase.
+ */
+void phase_timer::stop(const char* phase, int64_t rows, int64_t bytes,
+                       vector<phase_metrics>* metrics)
+{
+    phase_metrics m;
+    m.phase = phase;
+    m.wall_time = wall.elapsed_time();
+    m.cpu_time = thread_cpu_time() - cpu_start;
+    m.rows = rows;
+    m.bytes = bytes;
+    m.peak_rss = peak_rss();
+    metrics->push_back(m);
+    restart();
+}
+
+static string metric_value(int64_t n)
+{
+    return n < 0 ? "NULL" : to_string(n);
+}
+
+/**
+ * \brief Adds the metrics of an update of a table to
+ * dbsystem.table_metrics.
+ *
+ * Errors are logged as warnings, since the metrics are informational.
+ *
+ * \param[in] table_name Table, or an empty string for phases that
+ * apply to all tables.
+ */
+void record_table_metrics(etymon::pgconn* conn, ldp_log* lg,
+                          const string& table_name,
+                          const vector<phase_metrics>& metrics)
+{
+    if (metrics.size() == 0)
+        return;
+    string values;
+    for (auto& m : metrics) {
+        char times[255];
+        snprintf(times, sizeof times, "%.3f, %.3f", m.wall_time, m.cpu_time);
+        values += string(values == "" ? "" : ",\n") +
+            "    (CURRENT_TIMESTAMP, '" + table_name + "', '" + m.phase +
+            "', " + times + ", " + metric_value(m.rows) + ", " +
+            metric_value(m.bytes) + ", " + to_string(m.peak_rss) + ")";
+    }
+    string sql =
+        "INSERT INTO dbsystem.table_metrics\n"
+        "    (updated, table_name, phase, wall_time, cpu_time, row_count,\n"
+        "     byte_count, peak_rss)\n"
+        "    VALUES\n" + values + ";";
+    lg->detail(sql);
+    try {
+        etymon::pgconn_result r(conn, sql);
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "update", table_name, "unable to record metrics: " + s, -1);
+    }
+}
+
@@ -0,0 +1,55 @@
+#ifndef LDP_METRICS_H
+#define LDP_METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../etymoncpp/include/postgres.h"
+#include "log.h"
+#include "timer.h"
+
+using namespace std;
+
+/**
+ * \brief Resources used by one phase of updating a table.
+ *
+ * Row and byte counts are -1 if they do not apply to the phase.
+ */
+class phase_metrics {
+public:
+    string phase;
+    double wall_time = 0;
+    double cpu_time = 0;
+    int64_t rows = -1;
+    int64_t bytes = -1;
+    int64_t peak_rss = 0;
+};
+
+/**
+ * \brief Measures consecutive phases of updating a table.
+ *
+ * CPU time is the client CPU time of the calling thread only, which
+ * must run the whole phase; it does not include other threads working
+ * on the phase, such as index workers, or time spent by the database
+ * server.  Peak RSS is the largest resident set size of the whole
+ * process up to the end of the phase; it is not specific to the table,
+ * and with the thread executor it includes memory used by all tables
+ * being updated concurrently.
+ */
+class phase_timer {
+public:
+    phase_timer();
+    void restart();
+    void stop(const char* phase, int64_t rows, int64_t bytes,
+              vector<phase_metrics>* metrics);
+private:
+    timer wall;
+    double cpu_start;
+};
+
+void record_table_metrics(etymon::pgconn* conn, ldp_log* lg,
+                          const string& table_name,
+                          const vector<phase_metrics>& metrics);
+
+#endif
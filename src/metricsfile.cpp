@@ -0,0 +1,246 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+
+#include "metricsfile.h"
+
+namespace fs = std::filesystem;
+
+class table_metrics_summary {
+public:
+    string updated;
+    double wall_time = 0;
+    map<string,double> phases;
+    double load_rows = -1;
+    double load_bytes = -1;
+    double history_rows = -1;
+};
+
+static string metric_number(double x)
+{
+    char buf[64];
+    snprintf(buf, sizeof buf, "%.15g", x);
+    return buf;
+}
+
+static void add_metric_header(const char* name, const char* type,
+                              const char* help, string* text)
+{
+    *text += string("# HELP ") + name + " " + help + "\n" +
+        "# TYPE " + name + " " + type + "\n";
+}
+
+static void add_metric(const char* name, const string& labels, double value,
+                       string* text)
+{
+    *text += string(name) + (labels == "" ? "" : "{" + labels + "}") + " " +
+        metric_number(value) + "\n";
+}
+
+metrics_file::metrics_file(const ldp_options& opt)
+{
+    enabled = opt.metrics_file;
+    fs::path datadir = opt.datadir;
+    filename = datadir / "ldp.prom";
+}
+
+/**
+ * \brief Marks the start of an update, from which errors are counted.
+ */
+void metrics_file::start_update(etymon::pgconn* conn, ldp_log* lg)
+{
+    running = true;
+    queued = 0;
+    workers = 0;
+    if (!enabled)
+        return;
+    try {
+        etymon::pgconn_result r(conn, "SELECT CURRENT_TIMESTAMP::text;");
+        update_start = PQgetvalue(r.result, 0, 0);
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "server", "", "unable to read time for metrics: " + s, -1);
+    }
+}
+
+void metrics_file::end_update()
+{
+    running = false;
+    queued = 0;
+    workers = 0;
+}
+
+/**
+ * \brief Sets the number of tables waiting to be extracted or staged,
+ * and the number of tables being staged or merged by workers.
+ */
+void metrics_file::set_queue(size_t queued, size_t workers)
+{
+    this->queued = queued;
+    this->workers = workers;
+}
+
+static void select_table_metrics(etymon::pgconn* conn,
+                                 map<string,table_metrics_summary>* tables)
+{
+    // All phases of an update of a table are recorded with the same
+    // time.  The latest update of each table is found with the index on
+    // (table_name, updated), rather than by scanning all metrics.
+    string sql =
+        "SELECT m.table_name, m.phase,\n"
+        "       extract(epoch FROM m.updated), m.wall_time, m.row_count, m.byte_count\n"
+        "    FROM dbsystem.tables AS t\n"
+        "        CROSS JOIN LATERAL\n"
+        "            (SELECT max(updated) AS last_updated\n"
+        "                 FROM dbsystem.table_metrics\n"
+        "                 WHERE table_name = t.table_name) AS l\n"
+        "        JOIN dbsystem.table_metrics AS m\n"
+        "            ON m.table_name = t.table_name AND\n"
+        "               m.updated = l.last_updated;";
+    etymon::pgconn_result r(conn, sql);
+    int n = PQntuples(r.result);
+    for (int i = 0; i < n; i++) {
+        table_metrics_summary& t = (*tables)[PQgetvalue(r.result, i, 0)];
+        string phase = PQgetvalue(r.result, i, 1);
+        t.updated = PQgetvalue(r.result, i, 2);
+        double wall_time = atof(PQgetvalue(r.result, i, 3));
+        t.wall_time += wall_time;
+        t.phases[phase] = wall_time;
+        bool has_rows = !PQgetisnull(r.result, i, 4);
+        double rows = atof(PQgetvalue(r.result, i, 4));
+        if (phase == "load") {
+            if (has_rows)
+                t.load_rows = rows;
+            if (!PQgetisnull(r.result, i, 5))
+                t.load_bytes = atof(PQgetvalue(r.result, i, 5));
+        }
+        if (phase == "merge" && has_rows)
+            t.history_rows = rows;
+    }
+}
+
+static void select_log_counts(etymon::pgconn* conn, const string& since,
+                              map<string,double>* counts)
+{
+    (*counts)["error"] = 0;
+    (*counts)["warning"] = 0;
+    if (since == "")
+        return;
+    string sql =
+        "SELECT level, count(*)\n"
+        "    FROM dbsystem.log\n"
+        "    WHERE log_time >= '" + since + "' AND\n"
+        "          level IN ('error', 'warning')\n"
+        "    GROUP BY level;";
+    etymon::pgconn_result r(conn, sql);
+    int n = PQntuples(r.result);
+    for (int i = 0; i < n; i++)
+        (*counts)[PQgetvalue(r.result, i, 0)] = atof(PQgetvalue(r.result, i, 1));
+}
+
+/**
+ * \brief Writes the metrics file, replacing any previous version.
+ *
+ * Errors are logged as warnings, and the previous file is left in
+ * place.
+ */
+void metrics_file::write(etymon::pgconn* conn, ldp_log* lg)
+{
+    if (!enabled)
+        return;
+    map<string,table_metrics_summary> tables;
+    map<string,double> log_counts;
+    try {
+        select_table_metrics(conn, &tables);
+        select_log_counts(conn, update_start, &log_counts);
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "server", "", "unable to read metrics: " + s, -1);
+        return;
+    }
+
+    string text;
+    add_metric_header("ldp_update_running", "gauge",
+                      "Whether an update is running.", &text);
+    add_metric("ldp_update_running", "", running ? 1 : 0, &text);
+    add_metric_header("ldp_update_queue_depth", "gauge",
+                      "Tables waiting to be extracted or staged.", &text);
+    add_metric("ldp_update_queue_depth", "", queued, &text);
+    add_metric_header("ldp_update_workers", "gauge",
+                      "Tables being staged or merged by workers.", &text);
+    add_metric("ldp_update_workers", "", workers, &text);
+    add_metric_header("ldp_update_log_messages", "gauge",
+                      "Messages logged since the current or last update started.",
+                      &text);
+    for (auto& [level, count] : log_counts)
+        add_metric("ldp_update_log_messages", "level=\"" + level + "\"", count, &text);
+    add_metric_header("ldp_database_connections_opened_total", "counter",
+                      "Database connections opened since LDP started.",
+                      &text);
+    add_metric("ldp_database_connections_opened_total", "", etymon::pgconn::opened(), &text);
+
+    add_metric_header("ldp_table_updated_timestamp_seconds", "gauge",
+                      "Time at which the last update of the table finished.",
+                      &text);
+    for (auto& [table, t] : tables)
+        add_metric("ldp_table_updated_timestamp_seconds", "table=\"" + table + "\"", atof(t.updated.c_str()), &text);
+    add_metric_header("ldp_table_update_duration_seconds", "gauge",
+                      "Duration of the last update of the table.", &text);
+    for (auto& [table, t] : tables)
+        add_metric("ldp_table_update_duration_seconds", "table=\"" + table + "\"", t.wall_time, &text);
+    add_metric_header("ldp_table_phase_duration_seconds", "gauge",
+                      "Duration of each phase of the last update of the table.",
+                      &text);
+    for (auto& [table, t] : tables) {
+        for (auto& [phase, wall_time] : t.phases)
+            add_metric("ldp_table_phase_duration_seconds", "table=\"" + table + "\",phase=\"" + phase + "\"", wall_time, &text);
+    }
+    add_metric_header("ldp_table_rows_per_second", "gauge",
+                      "Rows loaded per second in the load phase of the last update of the table.",
+                      &text);
+    for (auto& [table, t] : tables) {
+        auto load = t.phases.find("load");
+        if (t.load_rows >= 0 && load != t.phases.end() && load->second > 0)
+            add_metric("ldp_table_rows_per_second", "table=\"" + table + "\"", t.load_rows / load->second, &text);
+    }
+    add_metric_header("ldp_table_staged_bytes", "gauge",
+                      "Bytes of data staged in the last update of the table.",
+                      &text);
+    for (auto& [table, t] : tables) {
+        if (t.load_bytes >= 0)
+            add_metric("ldp_table_staged_bytes", "table=\"" + table + "\"", t.load_bytes, &text);
+    }
+    add_metric_header("ldp_table_history_rows_added", "gauge",
+                      "Rows added to the history table in the last update of the table.",
+                      &text);
+    for (auto& [table, t] : tables) {
+        if (t.history_rows >= 0)
+            add_metric("ldp_table_history_rows_added", "table=\"" + table + "\"", t.history_rows, &text);
+    }
+
+    // The file is written under a temporary name and then renamed, so
+    // that the collector never reads a partly written file.  The
+    // temporary name does not end in ".prom" and is ignored by the
+    // collector.
+    string tmp_filename = filename + ".tmp";
+    try {
+        {
+            etymon::file f(tmp_filename, "w");
+            if (fwrite(text.data(), 1, text.size(), f.fp) != text.size() ||
+                    fflush(f.fp) != 0)
+                throw runtime_error("error writing file: " + tmp_filename);
+        }
+        fs::rename(tmp_filename, filename);
+    } catch (exception& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "server", "", "unable to write metrics file: " + s, -1);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef LDP_METRICSFILE_H
+#define LDP_METRICSFILE_H
+
+#include <string>
+
+#include "../etymoncpp/include/postgres.h"
+#include "log.h"
+#include "options.h"
+
+using namespace std;
+
+/**
+ * \brief Metrics file in the Prometheus text format, for the textfile
+ * collector of node_exporter.
+ *
+ * The file is written only if enabled by the metrics_file option.  It
+ * reports the most recent update of each table as recorded in
+ * dbsystem.table_metrics, together with the state of the current or
+ * last update.  Each write replaces the file atomically, so that a
+ * partly written file is never read.
+ */
+class metrics_file {
+public:
+    metrics_file(const ldp_options& opt);
+    void start_update(etymon::pgconn* conn, ldp_log* lg);
+    void end_update();
+    void set_queue(size_t queued, size_t workers);
+    void write(etymon::pgconn* conn, ldp_log* lg);
+private:
+    bool enabled;
+    string filename;
+    bool running = false;
+    // Database time at which the current or last update started.
+    string update_start;
+    size_t queued = 0;
+    size_t workers = 0;
+};
+
+#endif
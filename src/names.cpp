@@ -15,4 +15,22 @@ void history_table_name(const string& table, string* newtable)
     *newtable = "history." + table;
 }
 
+// Converts a column name derived from a nested field path, such as
+// "metadata/created_date", to a database column name, such as
+// "metadata__created_date".
+void expand_column_name(const string& name, string* expanded)
+{
+    string s = name;
+    size_t p = 0;
+    while ( (p = s.find("/", p)) != string::npos) {
+        s.replace(p, 1, "__");
+        p += 2;
+    }
+    *expanded = s;
+}
+
+void data_index_name(const string& table, string* index)
+{
+    *index = table + "_data_gin_idx";
+}
 
@@ -8,6 +8,8 @@ using namespace std;
 void loading_table_name(const string& table, string* newtable);
 void latest_history_table_name(const string& table, string* newtable);
 void history_table_name(const string& table, string* newtable);
+void expand_column_name(const string& name, string* expanded);
+void data_index_name(const string& table, string* index);
 
 #endif
 
@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+
+#include "../etymoncpp/include/util.h"
+#include "notify.h"
+
+void listen_for_update_requests(etymon::pgconn* conn, ldp_log* lg)
+{
+    string sql = string("LISTEN ") + update_request_channel + ";";
+    lg->detail(sql);
+    { etymon::pgconn_result r(conn, sql); }
+}
+
+/**
+ * \brief Adds the tables named in the payload of an update request to
+ * a set of requested tables.
+ *
+ * The payload is a list of table names separated by commas or spaces.
+ * Unknown tables are logged as warnings and ignored.
+ *
+ * \param[in] lg Log.
+ * \param[in] schema Known tables.
+ * \param[in] payload Payload of the notification.
+ * \param[in,out] tables Requested tables.
+ */
+void add_requested_tables(ldp_log* lg, const ldp_schema& schema,
+                          const string& payload, set<string>* tables)
+{
+    string list = payload;
+    for (auto& c : list) {
+        if (c == ',')
+            c = ' ';
+    }
+    stringstream ss(list);
+    string table_name;
+    while (ss >> table_name) {
+        etymon::trim(&table_name);
+        bool found = false;
+        for (auto& table : schema.tables) {
+            if (table.name == table_name) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            lg->write(log_level::warning, "server", "", "update request for unknown table: " + table_name, -1);
+            continue;
+        }
+        if (tables->insert(table_name).second)
+            lg->write(log_level::trace, "", "", "update requested: " + table_name, -1);
+    }
+}
+
+static bool read_notifications(etymon::pgconn* conn, ldp_log* lg,
+                               const ldp_schema& schema, set<string>* tables)
+{
+    bool received = false;
+    PGnotify* notify;
+    while ((notify = PQnotifies(conn->conn)) != nullptr) {
+        if (string(notify->relname) == update_request_channel) {
+            add_requested_tables(lg, schema, notify->extra, tables);
+            received = true;
+        }
+        PQfreemem(notify);
+    }
+    return received;
+}
+
+/**
+ * \brief Waits for requests to update tables, sent with NOTIFY on the
+ * update request channel.
+ *
+ * The payload of each notification is a list of table names separated
+ * by commas or spaces.  Requested tables are added to a set, so that
+ * repeated requests for a table are combined until it is updated.
+ *
+ * \param[in] conn Database connection on which LISTEN has been run.
+ * \param[in] lg Log.
+ * \param[in] schema Known tables.
+ * \param[in] timeout_ms Maximum time to wait in milliseconds.
+ * \param[in,out] tables Requested tables.
+ * \retval true One or more requests were received.
+ * \retval false The timeout was reached without any requests.
+ */
+bool wait_for_update_requests(etymon::pgconn* conn, ldp_log* lg,
+                              const ldp_schema& schema, int timeout_ms,
+                              set<string>* tables)
+{
+    // Notifications may have been received during an earlier command.
+    if (read_notifications(conn, lg, schema, tables))
+        return true;
+    struct pollfd pfd;
+    pfd.fd = PQsocket(conn->conn);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0)
+        throw runtime_error("invalid database connection socket");
+    int r = poll(&pfd, 1, timeout_ms);
+    if (r < 0) {
+        if (errno == EINTR)
+            return false;
+        throw runtime_error("error waiting for update requests");
+    }
+    if (r == 0)
+        return false;
+    if (PQconsumeInput(conn->conn) == 0)
+        throw runtime_error(PQerrorMessage(conn->conn));
+    return read_notifications(conn, lg, schema, tables);
+}
@@ -0,0 +1,23 @@
+#ifndef LDP_NOTIFY_H
+#define LDP_NOTIFY_H
+
+#include <set>
+#include <string>
+
+#include "../etymoncpp/include/postgres.h"
+#include "log.h"
+#include "schema.h"
+
+using namespace std;
+
+// Channel on which update requests are received via NOTIFY.
+constexpr const char* update_request_channel = "ldp_update";
+
+void listen_for_update_requests(etymon::pgconn* conn, ldp_log* lg);
+void add_requested_tables(ldp_log* lg, const ldp_schema& schema,
+                          const string& payload, set<string>* tables);
+bool wait_for_update_requests(etymon::pgconn* conn, ldp_log* lg,
+                              const ldp_schema& schema, int timeout_ms,
+                              set<string>* tables);
+
+#endif
@@ -200,3 +200,33 @@ void config_set_environment(const string& env_str, deployment_environment* env)
     throw runtime_error("Unknown deployment environment: " + env_str);
 }
 
+
+void config_set_loading_table_mode(const string& mode_str, loading_table_mode* mode)
+{
+    if (mode_str == "logged") {
+        *mode = loading_table_mode::logged;
+        return;
+    }
+    if (mode_str == "freeze") {
+        *mode = loading_table_mode::freeze;
+        return;
+    }
+    if (mode_str == "unlogged") {
+        *mode = loading_table_mode::unlogged;
+        return;
+    }
+    throw runtime_error("Unknown loading table mode: " + mode_str);
+}
+
+void config_set_update_executor_mode(const string& mode_str, update_executor_mode* mode)
+{
+    if (mode_str == "process") {
+        *mode = update_executor_mode::process;
+        return;
+    }
+    if (mode_str == "thread") {
+        *mode = update_executor_mode::thread;
+        return;
+    }
+    throw runtime_error("Unknown update executor: " + mode_str);
+}
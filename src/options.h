@@ -35,6 +35,17 @@ enum class deployment_environment {
     development
 };
 
+enum class loading_table_mode {
+    logged,
+    freeze,
+    unlogged
+};
+
+enum class update_executor_mode {
+    process,
+    thread
+};
+
 class direct_extraction {
 public:
     vector<string> table_names;
@@ -85,11 +96,29 @@ public:
     string ldpconfig_user = "ldpconfig";
     //bool unsafe = false;
     string table;
+    // Tables due in a scheduled update, or empty for a full update.
+    vector<string> scheduled_tables;
     bool anonymize = true;
     bool record_history = true;
+    loading_table_mode loading_mode = loading_table_mode::logged;
+    bool keep_unlogged = false;
     bool all_indexes = false;
+    int index_workers = 4;
+    double index_min_selectivity = 0.0001;
+    int inference_sample_size = 0;
+    int flatten_depth = 2;
+    string maintenance_work_mem;
+    int max_parallel_maintenance_workers = -1;
     bool parallel_vacuum = true;
     bool parallel_update = true;
+    int update_workers = 4;
+    update_executor_mode update_executor = update_executor_mode::process;
+    // The default is 2 with the thread executor and 0 with the
+    // process executor; see config_options().
+    int extraction_workers = 0;
+    int extraction_disk_limit = 0;
+    int resume_max_age = 24;
+    bool metrics_file = false;
     bool index_large_varchar = false;
     bool savetemps = false;
     //FILE* err = stderr;
@@ -110,5 +139,7 @@ public:
 int evalopt(const etymon::command_args& cargs, ldp_options* opt);
 void debug_options(const ldp_options& o);
 void config_set_environment(const string& env_str, deployment_environment* env);
+void config_set_loading_table_mode(const string& mode_str, loading_table_mode* mode);
+void config_set_update_executor_mode(const string& mode_str, update_executor_mode* mode);
 
 #endif
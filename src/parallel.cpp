@@ -0,0 +1,98 @@
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "parallel.h"
+#include "timer.h"
+
+static void trim_error(string* s)
+{
+    if ( !(s->empty()) && s->back() == '\n' )
+        s->pop_back();
+}
+
+static void sql_task_worker(const etymon::pgconn_info& dbinfo,
+                            const vector<string>& session_sql,
+                            vector<sql_task>* tasks, atomic<size_t>* next,
+                            mutex* warnings_mutex, vector<string>* warnings)
+{
+    // Tasks are left unclaimed if this worker cannot connect, so that they
+    // can be picked up by the remaining workers.
+    etymon::pgconn* conn;
+    try {
+        conn = new etymon::pgconn(dbinfo);
+    } catch (runtime_error& e) {
+        string s = e.what();
+        trim_error(&s);
+        lock_guard<mutex> lock(*warnings_mutex);
+        warnings->push_back("unable to connect to database: " + s);
+        return;
+    }
+    for (auto& sql : session_sql) {
+        try {
+            { etymon::pgconn_result r(conn, sql); }
+        } catch (runtime_error& e) {
+            string s = e.what();
+            trim_error(&s);
+            lock_guard<mutex> lock(*warnings_mutex);
+            warnings->push_back(sql + ": " + s);
+        }
+    }
+    while (true) {
+        size_t x = (*next)++;
+        if (x >= tasks->size())
+            break;
+        sql_task& task = (*tasks)[x];
+        timer t;
+        try {
+            { etymon::pgconn_result r(conn, task.sql); }
+            task.ok = true;
+        } catch (runtime_error& e) {
+            task.error = e.what();
+            trim_error(&task.error);
+        }
+        task.elapsed_time = t.elapsed_time();
+    }
+    delete conn;
+}
+
+/**
+ * \brief Runs independent SQL statements concurrently, each worker
+ * thread using its own database connection.
+ *
+ * The statements in session_sql are run once on each connection before
+ * any tasks, and failures in them are reported as warnings.  The
+ * outcome and elapsed time of each task are recorded in the task.  No
+ * logging is done here, so that the caller can log the results from
+ * its own thread.
+ *
+ * \param[in] dbinfo Database connection parameters.
+ * \param[in] session_sql Statements to configure each session.
+ * \param[in] workers Maximum number of concurrent connections.
+ * \param[in,out] tasks Statements to run and their results.
+ * \param[out] warnings Connection and session configuration errors.
+ */
+void run_sql_tasks(const etymon::pgconn_info& dbinfo,
+                   const vector<string>& session_sql, size_t workers,
+                   vector<sql_task>* tasks, vector<string>* warnings)
+{
+    if (workers < 1)
+        workers = 1;
+    if (workers > tasks->size())
+        workers = tasks->size();
+    atomic<size_t> next(0);
+    mutex warnings_mutex;
+    vector<thread> threads;
+    for (size_t x = 0; x < workers; x++) {
+        threads.push_back(thread(sql_task_worker, cref(dbinfo),
+                                 cref(session_sql), tasks, &next,
+                                 &warnings_mutex, warnings));
+    }
+    for (auto& t : threads)
+        t.join();
+    for (auto& task : *tasks) {
+        if (!task.ok && task.error == "")
+            task.error = "not run: no database connection available";
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef LDP_PARALLEL_H
+#define LDP_PARALLEL_H
+
+#include <string>
+#include <vector>
+
+#include "../etymoncpp/include/postgres.h"
+
+using namespace std;
+
+class sql_task {
+public:
+    string label;
+    string sql;
+    bool ok = false;
+    string error;
+    double elapsed_time = -1;
+    sql_task(const string& label, const string& sql) : label(label), sql(sql) {}
+};
+
+void run_sql_tasks(const etymon::pgconn_info& dbinfo,
+                   const vector<string>& session_sql, size_t workers,
+                   vector<sql_task>* tasks, vector<string>* warnings);
+
+#endif
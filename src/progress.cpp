@@ -0,0 +1,95 @@
+#include <stdexcept>
+
+#include "progress.h"
+
+/**
+ * \brief Records the latest completed phase of a table in the current
+ * full update.
+ *
+ * The phases are, in order: "extracted", "staged", "merged",
+ * "placed", and "indexed".  A table that has reached "indexed" has
+ * been completely updated.  Errors are logged as warnings, since
+ * progress is only used to resume an interrupted update.
+ *
+ * \param[in] conn Database connection, which must not be in a
+ * transaction that could later be rolled back.
+ * \param[in] lg Log.
+ * \param[in] table_name Table.
+ * \param[in] phase Phase that has been completed.
+ */
+void record_update_progress(etymon::pgconn* conn, ldp_log* lg,
+                            const string& table_name, const char* phase)
+{
+    string sql =
+        "INSERT INTO dbsystem.update_progress\n"
+        "    (table_name, phase, updated)\n"
+        "    VALUES\n"
+        "    ('" + table_name + "', '" + phase + "', CURRENT_TIMESTAMP)\n"
+        "    ON CONFLICT (table_name) DO UPDATE\n"
+        "        SET phase = EXCLUDED.phase,\n"
+        "            updated = EXCLUDED.updated;";
+    lg->detail(sql);
+    try {
+        etymon::pgconn_result r(conn, sql);
+    } catch (runtime_error& e) {
+        lg->write(log_level::warning, "", table_name, table_name + ": unable to record update progress: " + phase, -1);
+    }
+}
+
+/**
+ * \brief Reads the progress of tables in an interrupted full update.
+ *
+ * The interrupted update is taken to have started at the earliest
+ * time recorded in its progress.  If that is longer ago than
+ * max_age_hours, the source data may have changed since the tables
+ * were updated, and so the progress is discarded and the update is
+ * not resumed.
+ *
+ * \param[in] conn Database connection.
+ * \param[in] lg Log.
+ * \param[in] max_age_hours Maximum age in hours of an interrupted
+ * update that is resumed, or 0 to never resume.
+ * \param[out] progress Latest completed phase by table name, which is
+ * empty if the previous full update was not interrupted or is not to
+ * be resumed.
+ */
+void select_update_progress(etymon::pgconn* conn, ldp_log* lg,
+                            int max_age_hours,
+                            map<string,string>* progress)
+{
+    progress->clear();
+    string sql =
+        "SELECT table_name,\n"
+        "       phase,\n"
+        "       min(updated) OVER ()::text,\n"
+        "       min(updated) OVER () < CURRENT_TIMESTAMP - INTERVAL '" + to_string(max_age_hours) + " hours'\n"
+        "    FROM dbsystem.update_progress;";
+    lg->detail(sql);
+    bool stale = false;
+    string started;
+    {
+        etymon::pgconn_result r(conn, sql);
+        int total = PQntuples(r.result);
+        for (int x = 0; x < total; x++)
+            (*progress)[PQgetvalue(r.result, x, 0)] = PQgetvalue(r.result, x, 1);
+        if (total > 0) {
+            started = PQgetvalue(r.result, 0, 2);
+            stale = (max_age_hours == 0 || string(PQgetvalue(r.result, 0, 3)) == "t");
+        }
+    }
+    if (stale) {
+        lg->write(log_level::info, "server", "", "not resuming interrupted update started at " + started + ": older than resume_max_age", -1);
+        progress->clear();
+        clear_update_progress(conn, lg);
+    }
+}
+
+/**
+ * \brief Removes all progress records at the end of a full update.
+ */
+void clear_update_progress(etymon::pgconn* conn, ldp_log* lg)
+{
+    string sql = "DELETE FROM dbsystem.update_progress;";
+    lg->detail(sql);
+    { etymon::pgconn_result r(conn, sql); }
+}
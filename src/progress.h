@@ -0,0 +1,19 @@
+#ifndef LDP_PROGRESS_H
+#define LDP_PROGRESS_H
+
+#include <map>
+#include <string>
+
+#include "../etymoncpp/include/postgres.h"
+#include "log.h"
+
+using namespace std;
+
+void record_update_progress(etymon::pgconn* conn, ldp_log* lg,
+                            const string& table_name, const char* phase);
+void select_update_progress(etymon::pgconn* conn, ldp_log* lg,
+                            int max_age_hours,
+                            map<string,string>* progress);
+void clear_update_progress(etymon::pgconn* conn, ldp_log* lg);
+
+#endif
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "schedule.h"
+
+/**
+ * \brief Estimates the time needed to stage and merge each table,
+ * based on previous updates.
+ *
+ * The estimate for a table is the duration of its most recent update
+ * recorded in dbsystem.log.  Tables that have no recorded duration
+ * but have a row count in dbsystem.tables are estimated from the
+ * average time per row of the other tables.  Tables with neither are
+ * left out of the result.
+ *
+ * \param[in] conn Database connection.
+ * \param[in] lg Log.
+ * \param[in] schema Tables to be estimated.
+ * \param[out] costs Estimated duration in seconds by table name.
+ */
+void select_table_costs(etymon::pgconn* conn, ldp_log* lg,
+                        const ldp_schema& schema, map<string,double>* costs)
+{
+    costs->clear();
+    map<string,double> durations;
+    map<string,double> row_counts;
+    try {
+        string sql =
+            "SELECT DISTINCT ON (table_name)\n"
+            "       table_name,\n"
+            "       elapsed_time\n"
+            "    FROM dbsystem.log\n"
+            "    WHERE type = 'update' AND\n"
+            "          table_name <> '' AND\n"
+            "          elapsed_time IS NOT NULL\n"
+            "    ORDER BY table_name, log_time DESC;";
+        lg->detail(sql);
+        {
+            etymon::pgconn_result r(conn, sql);
+            int total = PQntuples(r.result);
+            for (int x = 0; x < total; x++)
+                durations[PQgetvalue(r.result, x, 0)] = atof(PQgetvalue(r.result, x, 1));
+        }
+        sql =
+            "SELECT table_name,\n"
+            "       row_count\n"
+            "    FROM dbsystem.tables\n"
+            "    WHERE row_count IS NOT NULL;";
+        lg->detail(sql);
+        {
+            etymon::pgconn_result r(conn, sql);
+            int total = PQntuples(r.result);
+            for (int x = 0; x < total; x++)
+                row_counts[PQgetvalue(r.result, x, 0)] = atof(PQgetvalue(r.result, x, 1));
+        }
+    } catch (runtime_error& e) {
+        lg->write(log_level::warning, "server", "", string("unable to read previous update times: ") + e.what(), -1);
+        return;
+    }
+
+    double total_time = 0;
+    double total_rows = 0;
+    for (auto& [table_name, duration] : durations) {
+        auto rc = row_counts.find(table_name);
+        if (rc != row_counts.end() && rc->second > 0) {
+            total_time += duration;
+            total_rows += rc->second;
+        }
+    }
+    double time_per_row = (total_rows > 0 ? total_time / total_rows : 0);
+
+    for (auto& table : schema.tables) {
+        auto d = durations.find(table.name);
+        if (d != durations.end()) {
+            (*costs)[table.name] = d->second;
+            continue;
+        }
+        auto rc = row_counts.find(table.name);
+        if (rc != row_counts.end() && time_per_row > 0)
+            (*costs)[table.name] = rc->second * time_per_row;
+    }
+}
+
+/**
+ * \brief Orders tables longest first, and predicts the resulting
+ * makespan.
+ *
+ * Tables without an estimate are placed after all estimated tables,
+ * in their existing order.  The prediction assigns each table in
+ * order to the worker with the least work assigned so far.
+ *
+ * \param[in] costs Estimated duration in seconds by table name.
+ * \param[in] workers Number of tables processed concurrently.
+ * \param[in,out] tables Tables to be ordered.
+ * \return Predicted time in seconds until all tables are processed.
+ */
+double order_tables_by_cost(const map<string,double>& costs, size_t workers,
+                            vector<table_schema>* tables)
+{
+    auto cost = [&](const table_schema& t) -> double {
+        auto c = costs.find(t.name);
+        return c != costs.end() ? c->second : -1;
+    };
+    stable_sort(tables->begin(), tables->end(),
+                [&](const table_schema& t1, const table_schema& t2) {
+                    return cost(t1) > cost(t2);
+                });
+    vector<double> loads(workers < 1 ? 1 : workers, 0);
+    for (auto& table : *tables) {
+        double c = cost(table);
+        if (c <= 0)
+            continue;
+        *min_element(loads.begin(), loads.end()) += c;
+    }
+    return *max_element(loads.begin(), loads.end());
+}
+
+/**
+ * \brief Selects tables that are due to be updated according to
+ * dbconfig.update_schedule, and advances their next update times.
+ *
+ * The next update time of each due table is advanced by whole
+ * intervals to the first time in the future, so that updates that were
+ * missed while the server was not running are not repeated.
+ *
+ * \param[in] conn Database connection.
+ * \param[in] lg Log.
+ * \param[in] schema Known tables.
+ * \param[out] tables Names of due tables.
+ */
+void select_due_tables(etymon::pgconn* conn, ldp_log* lg,
+                       const ldp_schema& schema, vector<string>* tables)
+{
+    tables->clear();
+    string sql =
+        "UPDATE dbconfig.update_schedule\n"
+        "    SET next_update = next_update + update_interval *\n"
+        "        (FLOOR(EXTRACT(EPOCH FROM CURRENT_TIMESTAMP - next_update) /\n"
+        "               EXTRACT(EPOCH FROM update_interval)) + 1)\n"
+        "    WHERE enable_update AND\n"
+        "          next_update <= CURRENT_TIMESTAMP\n"
+        "    RETURNING table_name;";
+    lg->detail(sql);
+    etymon::pgconn_result r(conn, sql);
+    int total = PQntuples(r.result);
+    for (int x = 0; x < total; x++) {
+        string table_name = PQgetvalue(r.result, x, 0);
+        bool found = false;
+        for (auto& table : schema.tables) {
+            if (table.name == table_name) {
+                found = true;
+                break;
+            }
+        }
+        if (found)
+            tables->push_back(table_name);
+        else
+            lg->write(log_level::warning, "server", "", "unknown table in dbconfig.update_schedule: " + table_name, -1);
+    }
+}
+
+/**
+ * \brief Selects tables that have their own schedules in
+ * dbconfig.update_schedule and are not due to be updated.
+ *
+ * Full updates skip these tables, so that a table can be updated less
+ * often than full updates.
+ *
+ * \param[in] conn Database connection.
+ * \param[in] lg Log.
+ * \param[out] tables Names of tables that are not due.
+ */
+void select_tables_not_due(etymon::pgconn* conn, ldp_log* lg,
+                           vector<string>* tables)
+{
+    tables->clear();
+    string sql =
+        "SELECT table_name\n"
+        "    FROM dbconfig.update_schedule\n"
+        "    WHERE enable_update AND\n"
+        "          next_update > CURRENT_TIMESTAMP;";
+    lg->detail(sql);
+    etymon::pgconn_result r(conn, sql);
+    int total = PQntuples(r.result);
+    for (int x = 0; x < total; x++)
+        tables->push_back(PQgetvalue(r.result, x, 0));
+}
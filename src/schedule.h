@@ -0,0 +1,26 @@
+#ifndef LDP_SCHEDULE_H
+#define LDP_SCHEDULE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../etymoncpp/include/postgres.h"
+#include "log.h"
+#include "schema.h"
+
+using namespace std;
+
+void select_table_costs(etymon::pgconn* conn, ldp_log* lg,
+                        const ldp_schema& schema, map<string,double>* costs);
+
+void select_due_tables(etymon::pgconn* conn, ldp_log* lg,
+                       const ldp_schema& schema, vector<string>* tables);
+
+void select_tables_not_due(etymon::pgconn* conn, ldp_log* lg,
+                           vector<string>* tables);
+
+double order_tables_by_cost(const map<string,double>& costs, size_t workers,
+                            vector<table_schema>* tables);
+
+#endif
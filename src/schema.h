@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "log.h"
+#include "sketch.h"
 
 using namespace std;
 
@@ -28,6 +29,7 @@ public:
     unsigned int null = 0;
     unsigned int uuid = 0;
     unsigned int max_length = 0;
+    hll_sketch distinct;
 };
 
 class column_schema {
@@ -36,6 +38,11 @@ public:
     column_type type;
     unsigned int length = 0;
     string source_name;
+    // Estimated from the staged data, or -1 if not known.  Selectivity
+    // is the number of distinct values divided by the number of rows.
+    double distinct_count = -1;
+    double null_ratio = -1;
+    double selectivity = -1;
     static void type_to_string(column_type type, string* str);
     static bool select_type(ldp_log* lg, const string& table,
                             const string& source_path, const string& field,
@@ -53,6 +60,16 @@ enum class data_source_type {
     srs_error_records
 };
 
+// A JSON array that is extracted into a child table, with one row per
+// element.
+class array_table_schema {
+public:
+    string path;
+    string name;
+    // Number of rows loaded into the child table.
+    size_t row_count = 0;
+};
+
 class table_schema {
 public:
     bool skip = false;
@@ -63,6 +80,11 @@ public:
     vector<column_schema> columns;
     string module_name;
     string direct_source_table;
+    vector<array_table_schema> arrays;
+    // Nested fields that are flattened into columns below flatten_depth.
+    vector<string> flatten_paths;
+    // A GIN index is created on the data column.
+    bool data_index = false;
 };
 
 class ldp_schema {
@@ -0,0 +1,196 @@
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "../etymoncpp/include/util.h"
+#include "dbtype.h"
+#include "schemacache.h"
+
+// Changed when the format of the cached columns or the rules for
+// inferring them change, so that older caches are not used.
+static const char* schema_cache_version = "1";
+
+// Formats columns as one line per column, with tab-separated fields.
+void encode_columns(const vector<column_schema>& columns, string* text)
+{
+    text->clear();
+    for (auto& column : columns) {
+        char stats[255];
+        snprintf(stats, sizeof stats, "%.0f\t%g\t%g", column.distinct_count,
+                 column.null_ratio, column.selectivity);
+        *text += column.source_name + "\t" + column.name + "\t" +
+            to_string((int) column.type) + "\t" + to_string(column.length) +
+            "\t" + stats + "\n";
+    }
+}
+
+// Parses a whole string as a number.
+static bool parse_long(const string& s, long* value)
+{
+    if (s == "")
+        return false;
+    char* end;
+    *value = strtol(s.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+static bool parse_double(const string& s, double* value)
+{
+    if (s == "")
+        return false;
+    char* end;
+    *value = strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+
+/**
+ * \brief Decodes columns encoded by encode_columns().
+ *
+ * \retval true The columns were decoded.
+ * \retval false A line is malformed or has an invalid value.
+ */
+bool decode_columns(const string& text, vector<column_schema>* columns)
+{
+    columns->clear();
+    vector<string> lines;
+    etymon::split(text, '\n', &lines);
+    for (auto& line : lines) {
+        if (line == "")
+            continue;
+        vector<string> f;
+        etymon::split(line, '\t', &f);
+        if (f.size() != 7)
+            return false;
+        column_schema column;
+        column.source_name = f[0];
+        column.name = f[1];
+        if (column.source_name == "" || column.name == "")
+            return false;
+        long type, length;
+        if (!parse_long(f[2], &type) ||
+                type < (long) column_type::bigint || type > (long) column_type::varchar)
+            return false;
+        column.type = (column_type) type;
+        if (!parse_long(f[3], &length) || length < 0)
+            return false;
+        column.length = length;
+        if (!parse_double(f[4], &(column.distinct_count)) ||
+                !parse_double(f[5], &(column.null_ratio)) ||
+                !parse_double(f[6], &(column.selectivity)))
+            return false;
+        columns->push_back(column);
+    }
+    return true;
+}
+
+// Hashes the cached columns together with the settings that affect
+// inference of the table's schema: the fields dropped from the table,
+// and the depth and fields of nested objects that are flattened.
+void schema_fingerprint(const table_schema& table,
+                        const field_set& drop_fields, int flatten_depth,
+                        const string& columns, string* fingerprint)
+{
+    string input = string(schema_cache_version) + "\n" + table.source_spec +
+        "\n";
+    for (auto& [t, f] : drop_fields.fields) {
+        if (t == table.name)
+            input += f + "\n";
+    }
+    input += "flatten_depth=" + to_string(flatten_depth) + "\n";
+    for (auto& path : table.flatten_paths)
+        input += "flatten=" + path + "\n";
+    input += columns;
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : input) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    char buf[17];
+    snprintf(buf, sizeof buf, "%016llx", (unsigned long long) h);
+    *fingerprint = buf;
+}
+
+/**
+ * \brief Reads the schema cached for a table in a previous update.
+ *
+ * A cached schema is not used if its fingerprint does not match, which
+ * occurs if the fields dropped from the table or the flattening of
+ * nested fields have changed, or the cache was written by a different
+ * version of LDP.
+ *
+ * \param[in] conn Database connection.
+ * \param[in] lg Log.
+ * \param[in] table Table to look up.
+ * \param[in] drop_fields Fields removed from records before staging.
+ * \param[in] flatten_depth Depth of nested objects stored in columns.
+ * \param[out] columns Cached columns.
+ * \param[out] row_count Number of rows staged with the cached schema.
+ * \retval true A valid cached schema was found.
+ * \retval false No cached schema is available.
+ */
+bool select_cached_schema(etymon::pgconn* conn, ldp_log* lg,
+                          const table_schema& table,
+                          const field_set& drop_fields, int flatten_depth,
+                          vector<column_schema>* columns,
+                          size_t* row_count)
+{
+    columns->clear();
+    string sql =
+        "SELECT fingerprint,\n"
+        "       columns,\n"
+        "       row_count\n"
+        "    FROM dbsystem.table_schemas\n"
+        "    WHERE table_name = '" + table.name + "';";
+    lg->detail(sql);
+    etymon::pgconn_result r(conn, sql);
+    if (PQntuples(r.result) < 1)
+        return false;
+    string stored = PQgetvalue(r.result, 0, 0);
+    string text = PQgetvalue(r.result, 0, 1);
+    *row_count = strtoull(PQgetvalue(r.result, 0, 2), nullptr, 10);
+    string fingerprint;
+    schema_fingerprint(table, drop_fields, flatten_depth, text, &fingerprint);
+    if (fingerprint != stored || !decode_columns(text, columns) ||
+            columns->empty()) {
+        columns->clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Saves the schema of a staged table for use in later updates.
+ */
+void save_cached_schema(etymon::pgconn* conn, ldp_log* lg,
+                        const table_schema& table,
+                        const field_set& drop_fields, int flatten_depth,
+                        size_t row_count)
+{
+    string text, fingerprint;
+    encode_columns(table.columns, &text);
+    schema_fingerprint(table, drop_fields, flatten_depth, text, &fingerprint);
+    dbtype dbt(conn);
+    string encoded;
+    dbt.encode_string_const(text.c_str(), &encoded);
+    string sql =
+        "INSERT INTO dbsystem.table_schemas\n"
+        "    (table_name, fingerprint, columns, row_count, updated)\n"
+        "    VALUES\n"
+        "    ('" + table.name + "', '" + fingerprint + "', " + encoded + ", " +
+        to_string(row_count) + ", CURRENT_TIMESTAMP)\n"
+        "    ON CONFLICT (table_name) DO UPDATE\n"
+        "    SET fingerprint = EXCLUDED.fingerprint,\n"
+        "        columns = EXCLUDED.columns,\n"
+        "        row_count = EXCLUDED.row_count,\n"
+        "        updated = EXCLUDED.updated;";
+    lg->detail(sql);
+    try {
+        etymon::pgconn_result r(conn, sql);
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "update", table.name, "unable to save table schema: " + s, -1);
+    }
+}
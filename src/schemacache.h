@@ -0,0 +1,31 @@
+#ifndef LDP_SCHEMACACHE_H
+#define LDP_SCHEMACACHE_H
+
+#include <string>
+#include <vector>
+
+#include "../etymoncpp/include/postgres.h"
+#include "anonymize.h"
+#include "log.h"
+#include "schema.h"
+
+using namespace std;
+
+void encode_columns(const vector<column_schema>& columns, string* text);
+bool decode_columns(const string& text, vector<column_schema>* columns);
+void schema_fingerprint(const table_schema& table,
+                        const field_set& drop_fields, int flatten_depth,
+                        const string& columns, string* fingerprint);
+
+bool select_cached_schema(etymon::pgconn* conn, ldp_log* lg,
+                          const table_schema& table,
+                          const field_set& drop_fields, int flatten_depth,
+                          vector<column_schema>* columns,
+                          size_t* row_count);
+
+void save_cached_schema(etymon::pgconn* conn, ldp_log* lg,
+                        const table_schema& table,
+                        const field_set& drop_fields, int flatten_depth,
+                        size_t row_count);
+
+#endif
@@ -0,0 +1,59 @@
+#include <cmath>
+
+#include "sketch.h"
+
+// Number of index bits; the sketch has 2^hll_precision registers.
+static const int hll_precision = 12;
+
+static uint64_t hash_bytes(const void* data, size_t length)
+{
+    // FNV-1a followed by a finalizer, so that all bits are mixed.
+    uint64_t h = 14695981039346656037ULL;
+    const unsigned char* p = (const unsigned char*) data;
+    for (size_t x = 0; x < length; x++) {
+        h ^= p[x];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void hll_sketch::add(const void* data, size_t length)
+{
+    if (registers.empty())
+        registers.assign((size_t) 1 << hll_precision, 0);
+    uint64_t h = hash_bytes(data, length);
+    size_t index = h >> (64 - hll_precision);
+    uint64_t rest = h << hll_precision;
+    uint8_t rank = 1;
+    while (rank <= 64 - hll_precision && (rest & ((uint64_t) 1 << 63)) == 0) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > registers[index])
+        registers[index] = rank;
+}
+
+double hll_sketch::estimate() const
+{
+    if (registers.empty())
+        return 0;
+    double m = registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t r : registers) {
+        sum += ldexp(1.0, -r);
+        if (r == 0)
+            zeros++;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    // Linear counting is more accurate for small cardinalities.
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros);
+    return e;
+}
@@ -0,0 +1,25 @@
+#ifndef LDP_SKETCH_H
+#define LDP_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/**
+ * \brief HyperLogLog sketch for estimating the number of distinct
+ * values.
+ *
+ * The sketch uses 4096 one-byte registers, allocated when the first
+ * value is added, and has a typical relative error of about 2%.
+ */
+class hll_sketch {
+public:
+    void add(const void* data, size_t length);
+    double estimate() const;
+private:
+    vector<uint8_t> registers;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <random>
 #include <regex>
 
 #include "../etymoncpp/include/mallocptr.h"
@@ -11,6 +12,7 @@
 #include "camelcase.h"
 #include "dbtype.h"
 #include "names.h"
+#include "parallel.h"
 #include "rapidjson/document.h"
 #include "rapidjson/filereadstream.h"
 #include "rapidjson/pointer.h"
@@ -19,6 +21,7 @@
 #include "rapidjson/stringbuffer.h"
 #include "schema.h"
 #include "stage.h"
+#include "timer.h"
 
 namespace fs = std::filesystem;
 namespace json = rapidjson;
@@ -27,14 +30,16 @@ const long unsigned int copy_buffer_size = 12500000;
 
 constexpr json::ParseFlag pflags = json::kParseTrailingCommasFlag;
 
-static void expand_column_name(const string& name, string* expanded)
+static unsigned int min_varchar_size(unsigned int varchar_size);
+
+array_rows::array_rows(const string& path) : path(path), f(path, "w+")
 {
-    string s = name;
-    size_t p = s.find("/");
-    if (p != string::npos) {
-        s.replace(p, 1, "__");
-    }
-    *expanded = s;
+}
+
+array_rows::~array_rows()
+{
+    error_code ec;
+    fs::remove(path, ec);
 }
 
 struct name_comparator {
@@ -83,45 +88,74 @@ bool data_to_filter(const table_schema& table, const string& field)
     return true;
 }
 
+// Checks whether a field is flattened into a column.  Fields are
+// flattened up to flatten_depth levels of nested objects, and below that
+// if they are listed for the table.  Fields within arrays are not
+// flattened; obj is false for them.
+static bool flatten_field(const table_schema& table, const string& field,
+                          unsigned int depth, unsigned int flatten_depth,
+                          bool obj)
+{
+    if (depth == 0 || !obj)
+        return false;
+    if (depth <= flatten_depth)
+        return true;
+    for (const auto& path : table.flatten_paths) {
+        if (field.compare(0, path.length(), path) == 0 &&
+                (field.length() == path.length() ||
+                 field[path.length()] == '/'))
+            return true;
+    }
+    return false;
+}
+
 // Collect statistics and anonymize data
 void process_json_record(const table_schema& table,
                          json::Document* root,
                          json::Value* node,
                          bool collect_stats,
+                         unsigned int flatten_depth,
                          field_set* drop_fields,
                          const string& field,
                          unsigned int depth,
                          map<string,type_counts>* stats,
                          bool obj)
 {
+    bool column = (collect_stats &&
+                   flatten_field(table, field, depth, flatten_depth, obj));
     switch (node->GetType()) {
         case json::kNullType:
-            if (collect_stats && (depth == 1 || (depth == 2 && obj)))
+            if (column)
                 (*stats)[field.c_str() + 1].null++;
             break;
         case json::kTrueType:
         case json::kFalseType:
             if (drop_fields->find(table.name, field))
                 json::Pointer(field.c_str()).Set(*root, false);
-            if (collect_stats && (depth == 1 || (depth == 2 && obj)))
+            if (column) {
+                bool b = node->GetBool();
                 (*stats)[field.c_str() + 1].boolean++;
+                (*stats)[field.c_str() + 1].distinct.add(&b, sizeof b);
+            }
             break;
         case json::kNumberType:
             if (drop_fields->find(table.name, field))
                 json::Pointer(field.c_str()).Set(*root, 0);
-            if (collect_stats && (depth == 1 || (depth == 2 && obj))) {
+            if (column) {
                 (*stats)[field.c_str() + 1].number++;
                 if (node->IsInt() || node->IsUint() || node->IsInt64() ||
                         node->IsUint64())
                     (*stats)[field.c_str() + 1].integer++;
                 else
                     (*stats)[field.c_str() + 1].floating++;
+                double d = node->GetDouble();
+                (*stats)[field.c_str() + 1].distinct.add(&d, sizeof d);
             }
             break;
         case json::kStringType:
             if (drop_fields->find(table.name, field))
                 json::Pointer(field.c_str()).Set(*root, "");
-            if (collect_stats && (depth == 1 || (depth == 2 && obj))) {
+            if (column) {
                 (*stats)[field.c_str() + 1].string++;
                 if (is_uuid(node->GetString()))
                     (*stats)[field.c_str() + 1].uuid++;
@@ -130,6 +164,7 @@ void process_json_record(const table_schema& table,
                 size_t slen = strlen(node->GetString());
                 if (slen > (*stats)[field.c_str() + 1].max_length)
                     (*stats)[field.c_str() + 1].max_length = slen;
+                (*stats)[field.c_str() + 1].distinct.add(node->GetString(), slen);
             }
             break;
         case json::kArrayType:
@@ -148,7 +183,7 @@ void process_json_record(const table_schema& table,
                     string new_field = field;
                     new_field += '/';
                     new_field += to_string(x);
-                    process_json_record(table, root, i, collect_stats, drop_fields, new_field, depth + 1, stats, false);
+                    process_json_record(table, root, i, collect_stats, flatten_depth, drop_fields, new_field, depth + 1, stats, false);
                     x++;
                 }
             }
@@ -168,7 +203,7 @@ void process_json_record(const table_schema& table,
                 string new_field = field;
                 new_field += '/';
                 new_field += i->name.GetString();
-                process_json_record(table, root, &(i->value), collect_stats, drop_fields, new_field, depth + 1, stats, true);
+                process_json_record(table, root, &(i->value), collect_stats, flatten_depth, drop_fields, new_field, depth + 1, stats, obj);
             }
             break;
         default:
@@ -209,6 +244,12 @@ public:
     size_t record_count = 0;
     size_t total_record_count = 0;
     string* copy_buffer;
+    id_summary* ids;
+    // If not null, statistics are collected and types checked while
+    // loading, and values that do not fit are counted here by column.
+    map<string,size_t>* conflicts = nullptr;
+    // Rows for child tables of arrays, if any.
+    vector<unique_ptr<array_rows>>* arrays = nullptr;
     JSONHandler(int pass,
                 const ldp_options& options,
                 ldp_log* lg,
@@ -217,7 +258,8 @@ public:
                 const dbtype& dbt,
                 field_set* drop_fields,
                 map<string,type_counts>* statistics,
-                string* copy_buffer) :
+                string* copy_buffer,
+                id_summary* ids) :
         pass(pass),
         opt(options),
         lg(lg),
@@ -226,7 +268,8 @@ public:
         conn(conn),
         dbt(dbt),
         drop_fields(drop_fields),
-        copy_buffer(copy_buffer) {}
+        copy_buffer(copy_buffer),
+        ids(ids) {}
     bool Default();
     bool StartObject();
     bool EndObject(json::SizeType memberCount);
@@ -270,6 +313,9 @@ static void end_copy_batch(const ldp_options& opt, ldp_log* lg,
                         const string& table, string* buffer,
                         etymon::pgconn* conn)
 {
+    // Without a connection, the rows are left in the buffer.
+    if (conn == nullptr)
+        return;
     int r = PQputCopyData(conn->conn, buffer->data(), buffer->length());
     if (r == -1) {
         throw runtime_error(PQerrorMessage(conn->conn));
@@ -305,9 +351,84 @@ static void json_value_to_string(const json::Value& val, string* strval)
     *strval = "INVALID";
 }
 
-static void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
+// Checks whether a value can be loaded into a column of a cached or
+// sampled schema.
+static bool value_fits_column(const column_schema& column,
+                              const json::Value& value)
+{
+    switch (column.type) {
+    case column_type::bigint:
+        return value.IsInt();
+    case column_type::boolean:
+        return value.IsBool();
+    case column_type::numeric:
+        return value.IsNumber();
+    case column_type::id:
+        return value.IsString() && is_uuid(value.GetString());
+    case column_type::timestamptz:
+        return value.IsString() && looks_like_date_time(value.GetString());
+    case column_type::varchar:
+        return !value.IsString() ||
+            value.GetStringLength() <= min_varchar_size(column.length);
+    }
+    return false;
+}
+
+/**
+ * \brief Writes a row for each element of the table's arrays in a
+ * record.
+ *
+ * Each row contains the parent id, the position of the element
+ * starting at 1, the element as text if it is a string, number, or
+ * boolean, and the element as JSON.  The text is NULL for other
+ * elements and for text that is too long for a VARCHAR column.
+ */
+void write_array_rows(const dbtype& dbt, const table_schema& table,
+        const json::Document& doc, const string& idenc,
+        vector<unique_ptr<array_rows>>* arrays)
+{
+    for (size_t x = 0; x < table.arrays.size(); x++) {
+        const json::Value* val = json::Pointer(table.arrays[x].path.c_str()).Get(doc);
+        if (val == nullptr || !(val->IsArray()))
+            continue;
+        array_rows* rows = (*arrays)[x].get();
+        int ordinality = 0;
+        string row, s;
+        for (json::Value::ConstValueIterator i = val->Begin();
+                i != val->End(); ++i) {
+            ordinality++;
+            row = idenc + "\t" + to_string(ordinality) + "\t";
+            // Scalar elements are also stored as text.
+            if (i->IsString()) {
+                dbt.encode_copy(i->GetString(), &s);
+            } else if (i->IsNumber() || i->IsBool()) {
+                json::StringBuffer json_text;
+                json::Writer<json::StringBuffer> writer(json_text);
+                i->Accept(writer);
+                s = json_text.GetString();
+            } else {
+                s = "\\N";
+            }
+            if (s.length() >= varchar_size - 1)
+                s = "\\N";
+            row += s + "\t";
+            json::StringBuffer json_text;
+            json::Writer<json::StringBuffer> writer(json_text);
+            i->Accept(writer);
+            dbt.encode_copy(json_text.GetString(), &s);
+            row += s + "\n";
+            if (fwrite(row.data(), 1, row.length(), rows->f.fp) != row.length())
+                throw runtime_error("unable to write to file: " + rows->path);
+            rows->count++;
+        }
+    }
+}
+
+void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
         const table_schema& table, const json::Document& doc,
-        size_t* record_count, size_t* total_record_count, string* copy_buffer)
+        size_t* record_count, size_t* total_record_count, string* copy_buffer,
+        id_summary* ids, map<string,size_t>* conflicts,
+        vector<unique_ptr<array_rows>>* arrays)
 {
     //if (*record_count > 0)
     //    *insert_buffer += ',';
@@ -322,12 +443,16 @@ static void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
     }
     if (id == nullptr)
         throw runtime_error("required string field \"id\" not found in record");
+    if (ids != nullptr)
+        ids->ids.add(id);
 
     // id
     string idenc;
     dbt.encode_copy(id, &idenc);
     *copy_buffer += idenc;
     *copy_buffer += '\t';
+    if (arrays != nullptr)
+        write_array_rows(dbt, table, doc, idenc, arrays);
 
     string s;
     double d;
@@ -356,6 +481,11 @@ static void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
             *copy_buffer += "\\N\t";
             continue;
         }
+        if (conflicts != nullptr && !value_fits_column(column, jsonValue)) {
+            (*conflicts)[column.name]++;
+            *copy_buffer += "\\N\t";
+            continue;
+        }
         switch (column.type) {
         case column_type::bigint:
             *copy_buffer += to_string(jsonValue.GetInt());
@@ -384,6 +514,11 @@ static void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
 	    string strval;
 	    json_value_to_string(jsonValue, &strval);
             dbt.encode_copy(strval.data(), &s);
+            if (ids != nullptr && column.type == column_type::id) {
+                string colname;
+                expand_column_name(column.name, &colname);
+                ids->add_reference(colname, strval.c_str());
+            }
 
             // Check if varchar exceeds maximum string length.
             if (s.length() >= varchar_size - 1) {
@@ -463,10 +598,10 @@ bool JSONHandler::EndObject(json::SizeType memberCount)
         json::Document doc;
         doc.ParseInsitu<pflags>(buffer);
 
-        bool collect_stats = (pass == 1);
+        bool collect_stats = (pass == 1 || conflicts != nullptr);
         string path;
         // Collect statistics and anonymize data.
-        process_json_record(table, &doc, &doc, collect_stats, drop_fields, path, 0, stats, true);
+        process_json_record(table, &doc, &doc, collect_stats, opt.flatten_depth, drop_fields, path, 0, stats, true);
 
         if (pass == 2) {
 
@@ -477,7 +612,7 @@ bool JSONHandler::EndObject(json::SizeType memberCount)
                 record_count = 0;
             }
 
-            writeTuple(opt, lg, dbt, table, doc, &record_count, &total_record_count, copy_buffer);
+            writeTuple(opt, lg, dbt, table, doc, &record_count, &total_record_count, copy_buffer, ids, conflicts, arrays);
         }
 
     } else {
@@ -662,51 +797,163 @@ size_t read_page_count(const data_source& source, ldp_log* lg,
     return count;
 }
 
+// Begins a COPY into a loading table.
+static void begin_copy(const ldp_options& opt, const string& table,
+                       etymon::pgconn* conn)
+{
+    string loading_table;
+    loading_table_name(table, &loading_table);
+    string sql = "COPY " + loading_table + " FROM STDIN";
+    // The loading table is created in the same transaction, which
+    // allows the rows to be written already frozen.
+    if (opt.loading_mode != loading_table_mode::logged)
+        sql += " WITH (FREEZE)";
+    sql += ";";
+    { etymon::pgconn_result r(conn, sql); }
+}
+
+static void end_copy(ldp_log* lg, etymon::pgconn* conn)
+{
+    int r = PQputCopyEnd(conn->conn, nullptr);
+    if (r == -1) {
+        throw runtime_error(PQerrorMessage(conn->conn));
+    }
+    if (r != 1) {
+        lg->warning("copy end result code: " + to_string(r));
+    }
+    PGresult* res = PQgetResult(conn->conn);
+    if (res == nullptr || PQresultStatus(res) == PGRES_FATAL_ERROR) {
+        string err = PQresultErrorMessage(res);
+        if (res != nullptr) {
+            PQclear(res);
+        }
+        throw runtime_error(err);
+    }
+    PQclear(res);
+}
+
+// Copies the rows of an array's child table from a file.
+static void copy_array_rows(const ldp_options& opt, ldp_log* lg,
+                            const array_table_schema& array,
+                            array_rows* rows, etymon::pgconn* conn)
+{
+    if (rows->count == 0)
+        return;
+    if (fflush(rows->f.fp) != 0 || fseek(rows->f.fp, 0, SEEK_SET) != 0)
+        throw runtime_error("unable to read file: " + rows->path);
+    begin_copy(opt, array.name, conn);
+    vector<char> buffer(1048576);
+    size_t n;
+    while ( (n = fread(buffer.data(), 1, buffer.size(), rows->f.fp)) > 0) {
+        if (PQputCopyData(conn->conn, buffer.data(), n) == -1)
+            throw runtime_error(PQerrorMessage(conn->conn));
+    }
+    if (ferror(rows->f.fp)) {
+        PQputCopyEnd(conn->conn, "unable to read array rows");
+        PGresult* res;
+        while ( (res = PQgetResult(conn->conn)) != nullptr)
+            PQclear(res);
+        throw runtime_error("unable to read file: " + rows->path);
+    }
+    end_copy(lg, conn);
+    lg->trace(array.name + ": staged group: " + to_string(rows->count) + " rows");
+}
+
+// Returns the directory for the array row files of pages being staged.
+// It is under the data directory rather than next to the pages, which
+// may be in a read-only or shared directory given by --sourcedir.
+static void array_rows_dir(const ldp_options& opt, string* dir)
+{
+    fs::path datadir = opt.datadir;
+    *dir = datadir / "tmp" / "arrays";
+}
+
 static void stage_page(const ldp_options& opt, ldp_log* lg, int pass,
                        const table_schema& table,
                        etymon::pgconn* conn, const dbtype &dbt,
                        map<string,type_counts>* stats, const string& filename,
                        char* read_buffer, size_t read_buffer_size,
-                       field_set* drop_fields)
+                       field_set* drop_fields, size_t* record_count,
+                       id_summary* ids, map<string,size_t>* conflicts,
+                       vector<size_t>* array_row_counts)
 {
     json::Reader reader;
     etymon::file f(filename, "r");
     json::FileReadStream is(f.fp, read_buffer, read_buffer_size);
 
+    // The array row files are removed when arrays is destroyed,
+    // including when an exception is thrown.
+    vector<unique_ptr<array_rows>> arrays;
     if (pass == 2) {
-        string loading_table;
-        loading_table_name(table.name, &loading_table);
-        string sql = "COPY " + loading_table + " FROM STDIN;";
-        { etymon::pgconn_result r(conn, sql); }
+        if (table.arrays.size() > 0) {
+            string dir;
+            array_rows_dir(opt, &dir);
+            fs::create_directories(dir);
+            string name = fs::path(filename).filename();
+            for (size_t x = 0; x < table.arrays.size(); x++) {
+                string path = dir;
+                etymon::join(&path, name + ".array" + to_string(x));
+                arrays.push_back(unique_ptr<array_rows>(new array_rows(path)));
+            }
+        }
+        begin_copy(opt, table.name, conn);
     }
 
     {
         string copy_buffer;
         copy_buffer.reserve(copy_buffer_size);
-        JSONHandler handler(pass, opt, lg, table, conn, dbt, drop_fields, stats, &copy_buffer);
-        reader.Parse(is, handler);
+        JSONHandler handler(pass, opt, lg, table, conn, dbt, drop_fields, stats, &copy_buffer, ids);
+        handler.conflicts = conflicts;
+        if (arrays.size() > 0)
+            handler.arrays = &arrays;
+        try {
+            reader.Parse(is, handler);
+        } catch (runtime_error& e) {
+            // End the copy, so that the transaction can be rolled back
+            // to a savepoint.
+            if (pass == 2) {
+                PQputCopyEnd(conn->conn, e.what());
+                PGresult* res;
+                while ( (res = PQgetResult(conn->conn)) != nullptr)
+                    PQclear(res);
+            }
+            throw;
+        }
+        *record_count += handler.total_record_count;
     }
 
     if (pass == 2) {
-        int r = PQputCopyEnd(conn->conn, nullptr);
-        if (r == -1) {
-            throw runtime_error(PQerrorMessage(conn->conn));
-        }
-        if (r != 1) {
-            lg->warning("copy end result code: " + to_string(r));
-        }
-        PGresult* res = PQgetResult(conn->conn);
-        if (res == nullptr || PQresultStatus(res) == PGRES_FATAL_ERROR) {
-            string err = PQresultErrorMessage(res);
-            if (res != nullptr) {
-                PQclear(res);
-            }
-            throw runtime_error(err);
+        end_copy(lg, conn);
+        // Child tables are copied after the parent table, since only
+        // one copy can be in progress on a connection.
+        for (size_t x = 0; x < arrays.size(); x++) {
+            copy_array_rows(opt, lg, table.arrays[x], arrays[x].get(), conn);
+            (*array_row_counts)[x] += arrays[x]->count;
         }
-        PQclear(res);
     }
 }
 
+/**
+ * \brief Parses a page of data in memory without a database
+ * connection.
+ *
+ * In pass 1, statistics are collected as when reading a data file.  In
+ * pass 2, the rows that would be copied to the loading table are
+ * appended to copy_buffer.  This allows staging to be measured apart
+ * from the database.
+ */
+void parse_page_text(const ldp_options& opt, ldp_log* lg, int pass,
+                     const table_schema& table, const dbtype& dbt,
+                     field_set* drop_fields,
+                     map<string,type_counts>* stats, const char* text,
+                     string* copy_buffer)
+{
+    json::Reader reader;
+    json::StringStream is(text);
+    JSONHandler handler(pass, opt, lg, table, nullptr, dbt, drop_fields, stats, copy_buffer, nullptr);
+    reader.Parse(is, handler);
+}
+
 static void compose_data_file_path(const string& load_dir,
                                    const table_schema& table,
                                    const string& source_name,
@@ -719,57 +966,288 @@ static void compose_data_file_path(const string& load_dir,
     *path += suffix;
 }
 
-void add_pkey_and_indexes(ldp_log* lg, const table_schema& table, etymon::pgconn* conn, dbtype* dbt, bool all_indexes)
+/**
+ * \brief Returns the total size in bytes of the extracted data files of a
+ * table.
+ */
+uintmax_t data_file_bytes(const ldp_options& opt,
+                          const vector<source_state>& source_states,
+                          ldp_log* lg, const table_schema& table,
+                          const string& load_dir)
 {
-    lg->detail("creating primary key indexes: " + table.name);
-    // If there is no table schema, define a primary key on (id) and return.
-    if (table.columns.size() == 0) {
-        string sql =
-            "ALTER TABLE " + table.name + "\n"
-            "    ADD PRIMARY KEY (id);";
+    uintmax_t bytes = 0;
+    error_code ec;
+    for (auto& state : source_states) {
+        size_t page_count = read_page_count(state.source, lg, load_dir,
+                                            table.name);
+        for (size_t page = 0; page < page_count; page++) {
+            string path;
+            compose_data_file_path(load_dir, table, state.source.source_name,
+                                   "_" + to_string(page) + ".json", &path);
+            uintmax_t size = fs::file_size(path, ec);
+            if (!ec)
+                bytes += size;
+        }
+    }
+    if (opt.load_from_dir != "") {
+        string path;
+        compose_data_file_path(load_dir, table, "", "_test.json", &path);
+        uintmax_t size = fs::file_size(path, ec);
+        if (!ec)
+            bytes += size;
+    }
+    return bytes;
+}
+
+/**
+ * \brief Returns the statements that configure a session for creating
+ * indexes, and the statements that restore the server settings.
+ */
+static void index_session_sql(const ldp_options& opt, vector<string>* session_sql,
+                              vector<string>* reset_sql)
+{
+    session_sql->clear();
+    reset_sql->clear();
+    if (opt.maintenance_work_mem != "") {
+        session_sql->push_back("SET maintenance_work_mem = '" + opt.maintenance_work_mem + "';");
+        reset_sql->push_back("RESET maintenance_work_mem;");
+    }
+    if (opt.max_parallel_maintenance_workers >= 0) {
+        session_sql->push_back("SET max_parallel_maintenance_workers = " + to_string(opt.max_parallel_maintenance_workers) + ";");
+        reset_sql->push_back("RESET max_parallel_maintenance_workers;");
+    }
+}
+
+static void run_session_sql(ldp_log* lg, etymon::pgconn* conn, const vector<string>& session_sql)
+{
+    for (auto& sql : session_sql) {
         lg->detail(sql);
         try {
             { etymon::pgconn_result r(conn, sql); }
         } catch (runtime_error& e) {
             lg->write(log_level::warning, "server", "", e.what(), -1);
         }
-        return;
+    }
+}
+
+static void add_pkey(ldp_log* lg, const table_schema& table, etymon::pgconn* conn, const string& sql)
+{
+    lg->detail(sql);
+    timer t;
+    try {
+        { etymon::pgconn_result r(conn, sql); }
+        lg->write(log_level::debug, "index", table.name, table.name + ": created primary key", t.elapsed_time());
+    } catch (runtime_error& e) {
+        lg->write(log_level::warning, "server", "", e.what(), -1);
+    }
+}
+
+data_index_build::data_index_build(const ldp_options& opt,
+                                   const table_schema& table) :
+    opt(opt),
+    table_name(table.name)
+{
+    vector<string> reset_sql;
+    index_session_sql(opt, &session_sql, &reset_sql);
+    string index_name;
+    data_index_name(table.name, &index_name);
+    tasks.push_back(sql_task("data", "CREATE INDEX " + index_name + " ON " + table.name + " USING GIN (data jsonb_path_ops);"));
+}
+
+data_index_build::~data_index_build()
+{
+    if (builder.joinable())
+        builder.join();
+}
+
+void data_index_build::start()
+{
+    builder = thread([this] {
+        run_sql_tasks(opt.dbinfo, session_sql, 1, &tasks, &warnings);
+    });
+}
+
+/**
+ * \brief Waits for the index to be built, and logs any errors.
+ *
+ * \param[out] elapsed_time Time taken to build the index.
+ * \retval true The index was created.
+ * \retval false The index was not created.
+ */
+bool data_index_build::wait(ldp_log* lg, double* elapsed_time)
+{
+    if (!builder.joinable())
+        return false;
+    builder.join();
+    for (auto& w : warnings)
+        lg->write(log_level::warning, "server", "", w, -1);
+    sql_task& task = tasks[0];
+    if (!task.ok) {
+        lg->detail(task.error);
+        lg->write(log_level::warning, "server", "", "Unable to create GIN index: table=" + table_name + " column=data", -1);
+        return false;
+    }
+    lg->write(log_level::debug, "index", table_name, table_name + ": created index: data", task.elapsed_time);
+    *elapsed_time = task.elapsed_time;
+    return true;
+}
+
+/**
+ * \brief Adds the primary key and indexes to a table that has been
+ * placed.
+ *
+ * \param[in] data_index If not null, the build of the GIN index on the
+ * data column, which is started after the primary key has been added
+ * and is not waited for.
+ */
+void add_pkey_and_indexes(const ldp_options& opt, ldp_log* lg, const table_schema& table, etymon::pgconn* conn, dbtype* dbt,
+                          data_index_build* data_index)
+{
+    lg->detail("creating primary key indexes: " + table.name);
+    // The connection may be leased from a pool, and so the session
+    // settings are reset before returning.
+    vector<string> session_sql, reset_sql;
+    index_session_sql(opt, &session_sql, &reset_sql);
+    run_session_sql(lg, conn, session_sql);
+    // If there is no table schema, define a primary key on (id).
+    if (table.columns.size() == 0) {
+        string sql =
+            "ALTER TABLE " + table.name + "\n"
+            "    ADD PRIMARY KEY (id);";
+        add_pkey(lg, table, conn, sql);
     }
     // If there is a table schema, define the primary key and optionally create indexes.
+    // The primary key is added first, because ALTER TABLE holds an exclusive
+    // lock that would block the index builds; these can then run
+    // concurrently with one another.
+    vector<sql_task> tasks;
     for (const auto& column : table.columns) {
         if (column.name == "id") {
             string sql =
                 "ALTER TABLE " + table.name + "\n"
                 "    ADD PRIMARY KEY (id) WITH (fillfactor=100);";
-            lg->detail(sql);
-            try {
-                { etymon::pgconn_result r(conn, sql); }
-            } catch (runtime_error& e) {
-                lg->write(log_level::warning, "server", "", e.what(), -1);
-            }
+            add_pkey(lg, table, conn, sql);
         } else {
             bool index = false;
             if (column.type == column_type::id) {
                 index = true;
             }
-            if (all_indexes && column.name != "data" && (column.type != column_type::varchar || column.length < 200)) {
+            if (opt.all_indexes && column.name != "data" && (column.type != column_type::varchar || column.length < 200)) {
+                index = true;
+            }
+            // Nested fields that are listed to be flattened are also
+            // indexed.
+            size_t depth = count(column.source_name.begin(), column.source_name.end(), '/') + 1;
+            if (depth > (size_t) opt.flatten_depth &&
+                    flatten_field(table, "/" + column.source_name, depth, opt.flatten_depth, true) &&
+                    (column.type != column_type::varchar || column.length < 200)) {
                 index = true;
             }
+            string colname;
+            expand_column_name(column.name, &colname);
+            // Columns with few distinct values, such as Booleans and
+            // status fields, are rarely useful to index.  Id columns are
+            // always indexed, because they are used in joins even when
+            // they refer to a small table, such as material types.
+            if (index && column.type != column_type::id &&
+                    column.selectivity >= 0 &&
+                    column.selectivity < opt.index_min_selectivity) {
+                lg->trace(table.name + ": skipped index on column with low selectivity: " + colname);
+                index = false;
+            }
             if (index) {
-                string colname;
-                expand_column_name(column.name, &colname);
                 string sql = "CREATE INDEX ON " + table.name + " (\"" + colname + "\") WITH (fillfactor=100);";
                 lg->detail(sql);
-                try {
-                    { etymon::pgconn_result r(conn, sql); }
-                } catch (runtime_error& e) {
-                    lg->write(log_level::warning, "server", "", "Unable to create B-tree index: table=" + table.name + " column=" + colname, -1);
-                }
+                tasks.push_back(sql_task(colname, sql));
+            }
+        }
+    }
+    // Child tables of arrays are indexed on the parent id.
+    for (const auto& array : table.arrays) {
+        string sql = "CREATE INDEX ON " + array.name + " (parent_id) WITH (fillfactor=100);";
+        lg->detail(sql);
+        tasks.push_back(sql_task(array.name + ".parent_id", sql));
+    }
+    // The primary key has been added, which would otherwise be blocked
+    // by the GIN index build.
+    if (data_index != nullptr)
+        data_index->start();
+    if (tasks.size() == 0) {
+        run_session_sql(lg, conn, reset_sql);
+        return;
+    }
+    if (opt.index_workers <= 1) {
+        for (auto& task : tasks) {
+            timer t;
+            try {
+                { etymon::pgconn_result r(conn, task.sql); }
+                task.ok = true;
+            } catch (runtime_error& e) {
+                task.error = e.what();
             }
+            task.elapsed_time = t.elapsed_time();
+        }
+    } else {
+        vector<string> warnings;
+        run_sql_tasks(opt.dbinfo, session_sql, opt.index_workers, &tasks, &warnings);
+        for (auto& w : warnings)
+            lg->write(log_level::warning, "server", "", w, -1);
+    }
+    run_session_sql(lg, conn, reset_sql);
+    for (auto& task : tasks) {
+        if (task.ok) {
+            lg->write(log_level::debug, "index", table.name, table.name + ": created index: " + task.label, task.elapsed_time);
+        } else {
+            lg->detail(task.error);
+            lg->write(log_level::warning, "server", "", "Unable to create B-tree index: table=" + table.name + " column=" + task.label, -1);
         }
     }
 }
 
+/**
+ * \brief Records the estimated distinct counts and null ratios of a
+ * staged table's columns in dbsystem.column_stats.
+ */
+void record_column_stats(ldp_log* lg, const table_schema& table,
+                         etymon::pgconn* conn)
+{
+    string values;
+    for (auto& column : table.columns) {
+        if (column.distinct_count < 0)
+            continue;
+        string colname;
+        expand_column_name(column.name, &colname);
+        char stats[255];
+        snprintf(stats, sizeof stats, "%.0f, %g", column.distinct_count,
+                 column.null_ratio);
+        values += string(values == "" ? "" : ",\n") +
+            "    ('" + table.name + "', '" + colname + "', " + stats +
+            ", CURRENT_TIMESTAMP)";
+    }
+    etymon::pgconn_batch batch(conn);
+    string sql =
+        "DELETE FROM dbsystem.column_stats\n"
+        "    WHERE table_name = '" + table.name + "';";
+    lg->detail(sql);
+    batch.add(sql);
+    if (values != "") {
+        sql =
+            "INSERT INTO dbsystem.column_stats\n"
+            "    (table_name, column_name, distinct_count, null_ratio, updated)\n"
+            "    VALUES\n" + values + ";";
+        lg->detail(sql);
+        batch.add(sql);
+    }
+    try {
+        batch.execute();
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::warning, "update", table.name, "unable to record column statistics: " + s, -1);
+    }
+}
+
 const unsigned int minimum_varchar_size = 16;
 
 static unsigned int min_varchar_size(unsigned int varchar_size)
@@ -788,13 +1266,18 @@ static void create_loading_table(const ldp_options& opt, ldp_log* lg,
     string loading_table;
     loading_table_name(table.name, &loading_table);
 
+    etymon::pgconn_batch batch(conn);
+
     string sql = "DROP TABLE IF EXISTS " + loading_table + ";";
     lg->detail(sql);
-    { etymon::pgconn_result r(conn, sql); }
+    batch.add(sql);
 
     string rskeys;
     dbt.redshift_keys("id", "id", &rskeys);
-    sql = "CREATE TABLE ";
+    if (opt.loading_mode == loading_table_mode::unlogged)
+        sql = "CREATE UNLOGGED TABLE ";
+    else
+        sql = "CREATE TABLE ";
     sql += loading_table;
     sql += " (\n"
         "    id UUID NOT NULL,\n";
@@ -807,7 +1290,10 @@ static void create_loading_table(const ldp_options& opt, ldp_log* lg,
             sql += colname;
             sql += "\" ";
             if (column.type == column_type::varchar) {
-                column_type = "VARCHAR(" + to_string(min_varchar_size(column.length)) + ")";
+                if (column.length >= varchar_size)
+                    column_type = "VARCHAR";
+                else
+                    column_type = "VARCHAR(" + to_string(min_varchar_size(column.length)) + ")";
                 if (lz4 && column.length > 127) {
                     column_type += " COMPRESSION lz4";
                 }
@@ -824,7 +1310,7 @@ static void create_loading_table(const ldp_options& opt, ldp_log* lg,
     }
     sql += "\n)" + rskeys + ";";
     lg->write(log_level::detail, "", "", sql, -1);
-    { etymon::pgconn_result r(conn, sql); }
+    batch.add(sql);
 
     // // Add comment on table.
     // comment_sql(loading_table, table.module_name, &sql);
@@ -833,20 +1319,109 @@ static void create_loading_table(const ldp_options& opt, ldp_log* lg,
 
     sql = "GRANT SELECT ON " + loading_table + " TO " + opt.ldpconfig_user + ";";
     lg->detail(sql);
-    { etymon::pgconn_result r(conn, sql); }
+    batch.add(sql);
     sql = "GRANT SELECT ON " + loading_table + " TO " + opt.ldp_user + ";";
     lg->detail(sql);
-    { etymon::pgconn_result r(conn, sql); }
+    batch.add(sql);
     for (auto& u : *users) {
         sql = "GRANT SELECT ON " + loading_table + " TO " + u + ";";
         lg->detail(sql);
-        { etymon::pgconn_result r(conn, sql); }
-        sql = "GRANT SELECT ON " + loading_table + " TO " + u + ";";
+        batch.add(sql);
+    }
+
+    // Child tables for arrays have one row per array element.
+    for (const auto& array : table.arrays) {
+        string child_table;
+        loading_table_name(array.name, &child_table);
+        sql = "DROP TABLE IF EXISTS " + child_table + ";";
         lg->detail(sql);
-        { etymon::pgconn_result r(conn, sql); }
+        batch.add(sql);
+        if (opt.loading_mode == loading_table_mode::unlogged)
+            sql = "CREATE UNLOGGED TABLE ";
+        else
+            sql = "CREATE TABLE ";
+        sql += child_table + " (\n"
+            "    parent_id UUID NOT NULL,\n"
+            "    ordinality INTEGER NOT NULL,\n"
+            "    value VARCHAR,\n"
+            "    data " + string(dbt.json_type()) + (lz4 ? " COMPRESSION lz4" : "") + "\n"
+            ");";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT SELECT ON " + child_table + " TO " + opt.ldpconfig_user + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT SELECT ON " + child_table + " TO " + opt.ldp_user + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        for (auto& u : *users) {
+            sql = "GRANT SELECT ON " + child_table + " TO " + u + ";";
+            lg->detail(sql);
+            batch.add(sql);
+        }
     }
+
+    batch.execute();
 }
 
+// Selects columns and their types from the statistics of a pass over
+// the data.
+bool infer_columns(ldp_log* lg, const table_schema& table,
+                   const map<string,type_counts>& stats,
+                   size_t record_count,
+                   vector<column_schema>* columns)
+{
+    columns->clear();
+    for (const auto& [field, counts] : stats) {
+        if (table.source_type == data_source_type::srs_marc_records && field != "id") {
+            continue;
+        }
+        if (table.source_type == data_source_type::srs_error_records && field != "id" && field != "description") {
+            continue;
+        }
+        column_schema column;
+        bool ok =
+            column_schema::select_type(lg, table.name,
+                                       table.source_spec, field, counts,
+                                       &column.type);
+        if (!ok)
+            return false;
+        string type_str;
+        column_schema::type_to_string(column.type, &type_str);
+        column.length = max( (unsigned int) 1, counts.max_length);
+        string newattr;
+        decode_camel_case(field.c_str(), &newattr);
+        lg->write(log_level::detail, "", "",
+                  string("Column: ") + newattr + string(" ") + type_str,
+                  -1);
+        column.name = newattr;
+        column.source_name = field;
+        if (record_count > 0) {
+            // Fields that are missing from a record are also null.
+            double present = counts.string + counts.number + counts.boolean;
+            column.distinct_count = min(counts.distinct.estimate(), present);
+            column.null_ratio = 1 - present / record_count;
+            column.selectivity = column.distinct_count / record_count;
+        }
+        columns->push_back(column);
+    }
+    return true;
+}
+
+/**
+ * \brief Infers a table schema from the data, and creates the loading
+ * table.
+ *
+ * If sample_size is greater than zero, whole pages are read in order
+ * until at least sample_size records have been analyzed, and the same
+ * number of pages again are chosen from the remaining pages by
+ * reservoir sampling.  If this leaves pages unread, the schema is only
+ * an estimate: VARCHAR columns are given no length limit, *sampled is
+ * set to true, *record_count is an estimate, and the loading table is
+ * not created.  The table should then be staged with
+ * stage_table_with_schema(), which checks the schema against all of the
+ * data.
+ */
 bool stage_table_1(const ldp_options& opt,
     const vector<source_state>& source_states,
     ldp_log* lg,
@@ -857,10 +1432,16 @@ bool stage_table_1(const ldp_options& opt,
     field_set* drop_fields,
     char* read_buffer,
     vector<string>* users,
-    bool lz4)
+    bool lz4,
+    size_t sample_size,
+    size_t* record_count,
+    bool* sampled)
 {
     map<string,type_counts> stats;
+    *record_count = 0;
+    *sampled = false;
 
+    vector<string> pages;
     for (auto& state : source_states) {
         size_t page_count = read_page_count(state.source, lg, load_dir,
                                             table->name);
@@ -873,21 +1454,63 @@ bool stage_table_1(const ldp_options& opt,
             string path;
             compose_data_file_path(load_dir, *table, state.source.source_name,
                                    "_" + to_string(page) + ".json", &path);
-            lg->write(log_level::detail, "", "", "staging: " + table->name + ": analyze: page: " + to_string(page), -1);
-            stage_page(opt, lg, 1, *table, conn, *dbt, &stats, path,
-                       read_buffer, sizeof read_buffer, drop_fields);
+            pages.push_back(path);
         }
     }
 
     if (opt.load_from_dir != "") {
         string path;
         compose_data_file_path(load_dir, *table, "", "_test.json", &path);
-        if (fs::exists(path)) {
-            lg->write(log_level::detail, "", "", "staging: " + table->name + ": analyze: test file", -1);
-            stage_page(opt, lg, 1, *table, conn, *dbt, &stats,
-                       path, read_buffer, sizeof read_buffer,
-                       drop_fields);
+        if (fs::exists(path))
+            pages.push_back(path);
+    }
+
+    // Select the pages to analyze.
+    size_t analyzed_pages = 0;
+    vector<size_t> selected;
+    if (sample_size == 0) {
+        for (size_t page = 0; page < pages.size(); page++)
+            selected.push_back(page);
+    } else {
+        size_t page = 0;
+        while (page < pages.size() && *record_count < sample_size) {
+            lg->write(log_level::detail, "", "", "staging: " + table->name + ": analyze: " + pages[page], -1);
+            stage_page(opt, lg, 1, *table, conn, *dbt, &stats, pages[page],
+                       read_buffer, sizeof read_buffer, drop_fields,
+                       record_count, nullptr, nullptr, nullptr);
+            analyzed_pages++;
+            page++;
         }
+        size_t leading = page;
+        // The generator is seeded from the table name, so that a table
+        // is sampled in the same way from one update to the next.
+        mt19937_64 rng(hash<string>()(table->name));
+        for (; page < pages.size(); page++) {
+            size_t seen = page - leading;
+            if (selected.size() < leading) {
+                selected.push_back(page);
+            } else {
+                uniform_int_distribution<size_t> dist(0, seen);
+                size_t x = dist(rng);
+                if (x < leading)
+                    selected[x] = page;
+            }
+        }
+        sort(selected.begin(), selected.end());
+        *sampled = (leading + selected.size() < pages.size());
+        if (*sampled) {
+            lg->write(log_level::trace, "", "", table->name + ": sampling " +
+                      to_string(leading + selected.size()) + " of " +
+                      to_string(pages.size()) + " pages", -1);
+        }
+    }
+
+    for (size_t page : selected) {
+        lg->write(log_level::detail, "", "", "staging: " + table->name + ": analyze: " + pages[page], -1);
+        stage_page(opt, lg, 1, *table, conn, *dbt, &stats, pages[page],
+                   read_buffer, sizeof read_buffer, drop_fields,
+                   record_count, nullptr, nullptr, nullptr);
+        analyzed_pages++;
     }
 
     for (const auto& [field, counts] : stats) {
@@ -912,48 +1535,42 @@ bool stage_table_1(const ldp_options& opt,
                   -1);
     }
 
-    for (const auto& [field, counts] : stats) {
-        if (table->source_type == data_source_type::srs_marc_records && field != "id") {
-            continue;
-        }
-        if (table->source_type == data_source_type::srs_error_records && field != "id" && field != "description") {
-            continue;
+    if (!infer_columns(lg, *table, stats, *record_count, &(table->columns)))
+        return false;
+
+    if (*sampled) {
+        // Values longer than those in the sample may occur.
+        for (auto& column : table->columns) {
+            if (column.type == column_type::varchar)
+                column.length = varchar_size;
         }
-        column_schema column;
-        bool ok =
-            column_schema::select_type(lg, table->name,
-                                       table->source_spec, field, counts,
-                                       &column.type);
-        if (!ok)
-            return false;
-        string type_str;
-        column_schema::type_to_string(column.type, &type_str);
-        column.length = max( (unsigned int) 1, counts.max_length);
-        string newattr;
-        decode_camel_case(field.c_str(), &newattr);
-        lg->write(log_level::detail, "", "",
-                  string("Column: ") + newattr + string(" ") + type_str,
-                  -1);
-        column.name = newattr;
-        column.source_name = field;
-        table->columns.push_back(column);
+        // Extrapolate the record count from the pages analyzed.
+        if (analyzed_pages > 0)
+            *record_count = *record_count * pages.size() / analyzed_pages;
+        return true;
     }
+
     create_loading_table(opt, lg, *table, conn, *dbt, users, lz4);
 
     return true;
 }
 
-bool stage_table_2(const ldp_options& opt,
-                   const vector<source_state>& source_states,
-                   ldp_log* lg,
-                   table_schema* table,
-                   etymon::pgconn* conn,
-                   dbtype* dbt,
-                   const string& load_dir,
-                   field_set* drop_fields,
-                   char* read_buffer)
+static void load_table(const ldp_options& opt,
+                       const vector<source_state>& source_states,
+                       ldp_log* lg,
+                       table_schema* table,
+                       etymon::pgconn* conn,
+                       dbtype* dbt,
+                       const string& load_dir,
+                       field_set* drop_fields,
+                       char* read_buffer,
+                       size_t* record_count,
+                       id_summary* ids,
+                       map<string,type_counts>* stats,
+                       map<string,size_t>* conflicts)
 {
-    map<string,type_counts> stats;
+    *record_count = 0;
+    vector<size_t> array_row_counts(table->arrays.size(), 0);
 
     for (auto& state : source_states) {
         size_t page_count = read_page_count(state.source, lg, load_dir,
@@ -968,9 +1585,10 @@ bool stage_table_2(const ldp_options& opt,
             compose_data_file_path(load_dir, *table, state.source.source_name,
                                    "_" + to_string(page) + ".json", &path);
             lg->write(log_level::detail, "", "", "staging: " + table->name + ": load: page: " + to_string(page), -1);
-            stage_page(opt, lg, 2, *table, conn, *dbt, &stats, path,
+            stage_page(opt, lg, 2, *table, conn, *dbt, stats, path,
                        read_buffer, sizeof read_buffer,
-                       drop_fields);
+                       drop_fields, record_count, ids, conflicts,
+                       &array_row_counts);
         }
     }
 
@@ -979,11 +1597,140 @@ bool stage_table_2(const ldp_options& opt,
         compose_data_file_path(load_dir, *table, "", "_test.json", &path);
         if (fs::exists(path)) {
             lg->write(log_level::detail, "", "", "staging: " + table->name + ": load: test file", -1);
-            stage_page(opt, lg, 2, *table, conn, *dbt, &stats,
+            stage_page(opt, lg, 2, *table, conn, *dbt, stats,
                        path, read_buffer, sizeof read_buffer,
-                       drop_fields);
+                       drop_fields, record_count, ids, conflicts,
+                       &array_row_counts);
         }
     }
 
+    for (size_t x = 0; x < table->arrays.size(); x++)
+        table->arrays[x].row_count = array_row_counts[x];
+}
+
+bool stage_table_2(const ldp_options& opt,
+                   const vector<source_state>& source_states,
+                   ldp_log* lg,
+                   table_schema* table,
+                   etymon::pgconn* conn,
+                   dbtype* dbt,
+                   const string& load_dir,
+                   field_set* drop_fields,
+                   char* read_buffer,
+                   size_t* record_count,
+                   id_summary* ids)
+{
+    map<string,type_counts> stats;
+    load_table(opt, source_states, lg, table, conn, dbt, load_dir,
+               drop_fields, read_buffer, record_count, ids, &stats, nullptr);
+    return true;
+}
+
+/**
+ * \brief Stages a table in a single pass, using a cached or sampled
+ * schema.
+ *
+ * The loading table is created from table->columns, which must contain
+ * the schema, within a savepoint.  Statistics are collected and value
+ * types are checked while the data are loaded; a value that does not
+ * fit its column is loaded as NULL and counted as a conflict.  If there
+ * are conflicts, or the columns inferred from the complete statistics
+ * differ from the schema, the savepoint is rolled back and the data are
+ * loaded again with the inferred columns, which widens or retypes the
+ * columns that did not fit.  VARCHAR columns that were created without
+ * a length limit are given the lengths found in the data.
+ *
+ * \param[in] origin Describes the schema in log messages.
+ * \retval true The table was staged.
+ * \retval false The table could not be staged, in which case
+ * table->columns is cleared, so that the table can be staged again with
+ * stage_table_1() and stage_table_2().
+ */
+bool stage_table_with_schema(const ldp_options& opt,
+                             const vector<source_state>& source_states,
+                             ldp_log* lg,
+                             table_schema* table,
+                             etymon::pgconn* conn,
+                             dbtype* dbt,
+                             const string& load_dir,
+                             field_set* drop_fields,
+                             char* read_buffer,
+                             vector<string>* users,
+                             bool lz4,
+                             const string& origin,
+                             size_t* record_count,
+                             id_summary* ids)
+{
+    { etymon::pgconn_result r(conn, "SAVEPOINT staged_schema;"); }
+
+    map<string,type_counts> stats;
+    map<string,size_t> conflicts;
+    vector<column_schema> columns;
+    string changed;
+    try {
+        create_loading_table(opt, lg, *table, conn, *dbt, users, lz4);
+        load_table(opt, source_states, lg, table, conn, dbt, load_dir,
+                   drop_fields, read_buffer, record_count, ids, &stats,
+                   &conflicts);
+        if (!infer_columns(lg, *table, stats, *record_count, &columns))
+            throw runtime_error("unable to infer column types");
+
+        if (columns.size() != table->columns.size()) {
+            changed = "columns added or removed";
+        } else {
+            for (size_t x = 0; x < columns.size(); x++) {
+                const column_schema& c = columns[x];
+                const column_schema& prior = table->columns[x];
+                if (c.source_name != prior.source_name ||
+                        c.type != prior.type) {
+                    changed = "column changed: " + c.name;
+                    break;
+                }
+            }
+        }
+
+        size_t conflict_count = 0;
+        for (const auto& [column, count] : conflicts) {
+            lg->detail(table->name + ": schema conflicts: " + column + ": " + to_string(count));
+            conflict_count += count;
+        }
+        if (conflict_count > 0 || changed != "") {
+            lg->write(log_level::debug, "update", table->name,
+                      table->name + ": " + origin + " schema conflicts: " +
+                      to_string(conflict_count) + " values in " +
+                      to_string(conflicts.size()) + " columns" +
+                      (changed != "" ? "; " + changed : ""), -1);
+            { etymon::pgconn_result r(conn, "ROLLBACK TO SAVEPOINT staged_schema;"); }
+            table->columns = columns;
+            // The summary is rebuilt for the retyped columns.
+            *ids = id_summary();
+            ids->ids.init(*record_count);
+            create_loading_table(opt, lg, *table, conn, *dbt, users, lz4);
+            load_table(opt, source_states, lg, table, conn, dbt, load_dir,
+                       drop_fields, read_buffer, record_count, ids, &stats,
+                       nullptr);
+        } else {
+            lg->trace(table->name + ": " + origin + " schema conflicts: 0");
+            for (size_t x = 0; x < columns.size(); x++) {
+                column_schema& column = table->columns[x];
+                if (column.length >= varchar_size)
+                    column.length = columns[x].length;
+                column.distinct_count = columns[x].distinct_count;
+                column.null_ratio = columns[x].null_ratio;
+                column.selectivity = columns[x].selectivity;
+            }
+        }
+    } catch (runtime_error& e) {
+        string s = e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->write(log_level::trace, "", "", table->name + ": " + origin + " schema not used: " + s, -1);
+        { etymon::pgconn_result r(conn, "ROLLBACK TO SAVEPOINT staged_schema;"); }
+        table->columns.clear();
+        *record_count = 0;
+        return false;
+    }
+
+    { etymon::pgconn_result r(conn, "RELEASE SAVEPOINT staged_schema;"); }
     return true;
 }
@@ -1,12 +1,73 @@
 #ifndef LDP_STAGE_H
 #define LDP_STAGE_H
 
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "../etymoncpp/include/util.h"
 #include "anonymize.h"
+#include "idfilter.h"
 #include "options.h"
+#include "parallel.h"
+#include "rapidjson/document.h"
 #include "util.h"
 
+/**
+ * \brief Rows of an array's child table for one page of data.
+ *
+ * The rows are written to a file while the page is copied into the
+ * parent table, and are copied into the child table afterwards.  The
+ * file is removed when the object is destroyed.
+ */
+class array_rows {
+public:
+    string path;
+    etymon::file f;
+    size_t count = 0;
+    array_rows(const string& path);
+    ~array_rows();
+};
+
 void encode_json(const char* str, string* newstr);
 
+// The functions below are used while staging each record, and are
+// declared here for benchmarks.
+
+bool looks_like_date_time(const char* str);
+
+void process_json_record(const table_schema& table,
+                         rapidjson::Document* root,
+                         rapidjson::Value* node,
+                         bool collect_stats,
+                         unsigned int flatten_depth,
+                         field_set* drop_fields,
+                         const string& field,
+                         unsigned int depth,
+                         map<string,type_counts>* stats,
+                         bool obj);
+
+void writeTuple(const ldp_options& opt, ldp_log* lg, const dbtype& dbt,
+        const table_schema& table, const rapidjson::Document& doc,
+        size_t* record_count, size_t* total_record_count, string* copy_buffer,
+        id_summary* ids, map<string,size_t>* conflicts,
+        vector<unique_ptr<array_rows>>* arrays);
+
+void write_array_rows(const dbtype& dbt, const table_schema& table,
+        const rapidjson::Document& doc, const string& idenc,
+        vector<unique_ptr<array_rows>>* arrays);
+
+bool infer_columns(ldp_log* lg, const table_schema& table,
+                   const map<string,type_counts>& stats,
+                   size_t record_count,
+                   vector<column_schema>* columns);
+
+void parse_page_text(const ldp_options& opt, ldp_log* lg, int pass,
+                     const table_schema& table, const dbtype& dbt,
+                     field_set* drop_fields,
+                     map<string,type_counts>* stats, const char* text,
+                     string* copy_buffer);
+
 bool stage_table_1(const ldp_options& opt,
     const vector<source_state>& source_states,
     ldp_log* lg, table_schema* table,
@@ -14,16 +75,65 @@ bool stage_table_1(const ldp_options& opt,
     field_set* drop_fields,
     char* read_buffer,
     vector<string>* users,
-    bool lz4);
+    bool lz4,
+    size_t sample_size,
+    size_t* record_count,
+    bool* sampled);
 
 bool stage_table_2(const ldp_options& opt,
     const vector<source_state>& source_states,
     ldp_log* lg, table_schema* table,
     etymon::pgconn* conn, dbtype* dbt, const string& loadDir,
     field_set* drop_fields,
-    char* read_buffer);
+    char* read_buffer,
+    size_t* record_count,
+    id_summary* ids);
+
+bool stage_table_with_schema(const ldp_options& opt,
+    const vector<source_state>& source_states,
+    ldp_log* lg, table_schema* table,
+    etymon::pgconn* conn, dbtype* dbt, const string& loadDir,
+    field_set* drop_fields,
+    char* read_buffer,
+    vector<string>* users,
+    bool lz4,
+    const string& origin,
+    size_t* record_count,
+    id_summary* ids);
+
+uintmax_t data_file_bytes(const ldp_options& opt,
+                          const vector<source_state>& source_states,
+                          ldp_log* lg, const table_schema& table,
+                          const string& load_dir);
+
+void record_column_stats(ldp_log* lg, const table_schema& table,
+                         etymon::pgconn* conn);
+
+/**
+ * \brief Builds the GIN index on the data column of a table in a
+ * background thread, using its own database connection.
+ *
+ * The build is started by add_pkey_and_indexes() once the primary key
+ * exists, so that it runs while the other indexes are created and the
+ * rest of the table's update continues.
+ */
+class data_index_build {
+public:
+    data_index_build(const ldp_options& opt, const table_schema& table);
+    ~data_index_build();
+    void start();
+    bool wait(ldp_log* lg, double* elapsed_time);
+private:
+    const ldp_options& opt;
+    string table_name;
+    vector<string> session_sql;
+    vector<sql_task> tasks;
+    vector<string> warnings;
+    thread builder;
+};
 
-void add_pkey_and_indexes(ldp_log* lg, const table_schema& table, etymon::pgconn* conn, dbtype* dbt, bool all_indexes);
+void add_pkey_and_indexes(const ldp_options& opt, ldp_log* lg, const table_schema& table, etymon::pgconn* conn, dbtype* dbt,
+                          data_index_build* data_index);
 
 #endif
 
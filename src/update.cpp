@@ -1,48 +1,65 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <curl/curl.h>
 #include <filesystem>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 
 #include "../etymoncpp/include/curl.h"
-#include "../etymoncpp/include/mallocptr.h"
+#include "../etymoncpp/include/util.h"
 #include "addcolumns.h"
+#include "arraytables.h"
 #include "dropfields.h"
 #include "extract.h"
+#include "flattenfields.h"
+#include "idfilter.h"
 #include "init.h"
 #include "log.h"
 #include "merge.h"
+#include "metrics.h"
+#include "metricsfile.h"
+#include "names.h"
+#include "parallel.h"
+#include "progress.h"
+#include "schedule.h"
+#include "schemacache.h"
 #include "stage.h"
 #include "timer.h"
 #include "update.h"
 #include "users.h"
+#include "workers.h"
 
 namespace fs = std::filesystem;
 
-void make_update_tmp_dir(const ldp_options& opt, string* loaddir)
+void make_update_tmp_dir(const ldp_options& opt, string* loaddir,
+                         bool keep_files)
 {
     fs::path datadir = opt.datadir;
     fs::path tmp = datadir / "tmp";
     fs::path tmppath = tmp / "update";
-    fs::remove_all(tmppath);
+    if (!keep_files)
+        fs::remove_all(tmppath);
     fs::create_directories(tmppath);
     *loaddir = tmppath;
 }
 
 bool is_foreign_key(etymon::pgconn* conn, ldp_log* lg,
-        const table_schema& table2, const column_schema& column2,
-        const table_schema& table1)
+        const string& table2, const string& column2, const string& table1)
 {
     string sql =
         "SELECT 1\n"
-        "    FROM " + table2.name + " AS r2\n"
-        "        JOIN " + table1.name + " AS r1\n"
-        "            ON r2." + column2.name + " = r1.id\n"
+        "    FROM " + table2 + " AS r2\n"
+        "        JOIN " + table1 + " AS r1\n"
+        "            ON r2." + column2 + " = r1.id\n"
         "    LIMIT 1;";
     lg->detail(sql);
     try {
@@ -53,6 +70,63 @@ bool is_foreign_key(etymon::pgconn* conn, ldp_log* lg,
     }
 }
 
+// Checks whether any of the given values is an id in a table.  The
+// values are looked up in batches, stopping at the first batch that
+// contains an id.
+static bool ids_exist(etymon::pgconn* conn, ldp_log* lg, const string& table,
+                      const vector<string>& values)
+{
+    const size_t batch_size = 1000;
+    for (size_t start = 0; start < values.size(); start += batch_size) {
+        string list;
+        for (size_t x = start; x < values.size() && x < start + batch_size; x++) {
+            const string& v = values[x];
+            // Values are read from columns of type id.
+            if (v.find_first_not_of("0123456789abcdef-") != string::npos)
+                continue;
+            list += (list == "" ? "'" : ", '") + v + "'";
+        }
+        if (list == "")
+            continue;
+        string sql =
+            "SELECT 1\n"
+            "    FROM " + table + "\n"
+            "    WHERE id IN (" + list + ")\n"
+            "    LIMIT 1;";
+        lg->detail(sql);
+        try {
+            etymon::pgconn_result r(conn, sql);
+            if (PQntuples(r.result) > 0)
+                return true;
+        } catch (runtime_error& e) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Reads the distinct values of a column, in lower case.
+static bool select_distinct_values(etymon::pgconn* conn, ldp_log* lg,
+                                   const string& table, const string& column,
+                                   vector<string>* values)
+{
+    values->clear();
+    string sql =
+        "SELECT DISTINCT lower(\"" + column + "\"::text)\n"
+        "    FROM " + table + "\n"
+        "    WHERE \"" + column + "\" IS NOT NULL;";
+    lg->detail(sql);
+    try {
+        etymon::pgconn_result r(conn, sql);
+        int total = PQntuples(r.result);
+        for (int x = 0; x < total; x++)
+            values->push_back(PQgetvalue(r.result, x, 0));
+        return true;
+    } catch (runtime_error& e) {
+        return false;
+    }
+}
+
 class reference {
 public:
     string referencing_table;
@@ -62,42 +136,93 @@ public:
     string constraint_name;
 };
 
-void search_table_foreign_keys(const ldp_options& opt,
-                               etymon::pgconn* conn, ldp_log* lg,
+/**
+ * \brief Finds columns in a table that appear to refer to the ids of
+ * other tables.
+ *
+ * If an id summary was saved when a referenced table was staged, all
+ * distinct values of the column are tested against the table's id
+ * filter, and the values that may be ids are then looked up in the
+ * database to confirm the reference.  Since the filter never omits an
+ * id, this finds the same references as a join query.  Tables for
+ * which no summary is available are searched with a join query.  The
+ * sampled values in the referencing table's summary are used only for
+ * logging.
+ *
+ * \param[in] conn Database connection for queries that may fail.
+ * \param[in] lg Log.
+ * \param[in] schema Tables that may be referenced.
+ * \param[in] table Table to search.
+ * \param[in] summaries Id summaries by table name.
+ * \param[in,out] refs References found, by referencing column.
+ */
+void search_table_foreign_keys(etymon::pgconn* conn, ldp_log* lg,
                                const ldp_schema& schema,
                                const table_schema& table,
-                               bool detectForeignKeys,
+                               const map<string,id_summary>& summaries,
                                map<string, vector<reference>>* refs)
 {
-    etymon::pgconn query_conn(opt.dbinfo);
     lg->detail("Searching for foreign keys in table: " + table.name);
-    //printf("Table: %s\n", table.name.c_str());
-    for (auto& column : table.columns) {
-        if (column.type != column_type::id)
-            continue;
-        if (column.name == "id")
-            continue;
-        //printf("    Column: %s\n", column.name.c_str());
-        for (auto& table1 : schema.tables) {
-            if (is_foreign_key(&query_conn, lg, table, column, table1)) {
 
-                string key = table.name + "." + column.name;
-                reference ref = {
-                    table.name,
-                    column.name,
-                    table1.name,
-                    "id"
-                };
-
-                //fprintf(stderr, "%s(%s) -> %s(%s)\n",
-                //        ref.referencing_table.c_str(),
-                //        ref.referencing_column.c_str(),
-                //        ref.referenced_table.c_str(),
-                //        ref.referenced_column.c_str());
+    // Columns of type id, and their sampled values if known.
+    map<string,const vector<string>*> columns;
+    auto summary = summaries.find(table.name);
+    if (summary != summaries.end()) {
+        for (auto& [column, sample] : summary->second.references)
+            columns[column] = &sample;
+    } else {
+        for (auto& column : table.columns) {
+            if (column.type == column_type::id && column.name != "id") {
+                string colname;
+                expand_column_name(column.name, &colname);
+                columns[colname] = nullptr;
+            }
+        }
+    }
 
-                (*refs)[key].push_back(ref);
+    for (auto& [column, sample] : columns) {
+        vector<string> values;
+        bool have_values = (summaries.size() > 0 &&
+                            select_distinct_values(conn, lg, table.name, column, &values));
+        for (auto& table1 : schema.tables) {
+            auto summary1 = summaries.find(table1.name);
+            bool found;
+            if (have_values && summary1 != summaries.end()) {
+                vector<string> matches;
+                for (auto& v : values) {
+                    if (summary1->second.ids.may_contain(v))
+                        matches.push_back(v);
+                }
+                found = (matches.size() > 0 &&
+                         ids_exist(conn, lg, table1.name, matches));
+            } else {
+                found = is_foreign_key(conn, lg, table.name, column,
+                                       table1.name);
+            }
+            if (!found)
+                continue;
 
+            if (sample != nullptr) {
+                size_t sampled = 0;
+                for (auto& v : *sample) {
+                    if (summary1 != summaries.end() &&
+                            summary1->second.ids.may_contain(v))
+                        sampled++;
+                }
+                lg->detail("foreign key: " + table.name + "." + column +
+                           " -> " + table1.name + ".id: " +
+                           to_string(sampled) + " of " +
+                           to_string(sample->size()) +
+                           " sampled values may match");
             }
+            string key = table.name + "." + column;
+            reference ref = {
+                table.name,
+                column,
+                table1.name,
+                "id"
+            };
+            (*refs)[key].push_back(ref);
         }
     }
 }
@@ -127,20 +252,30 @@ void select_foreign_key_constraints(etymon::pgconn* conn, ldp_log* lg,
     }
 }
 
-void remove_foreign_key_constraints(etymon::pgconn* conn, ldp_log* lg)
+/**
+ * \brief Removes the foreign key constraints that reference or are
+ * defined on a table, before the table is replaced.
+ */
+void remove_foreign_key_constraints(etymon::pgconn* conn, ldp_log* lg,
+                                    const string& table)
 {
     vector<reference> refs;
     select_foreign_key_constraints(conn, lg, &refs);
     for (auto& ref : refs) {
+        if (ref.referencing_table != table && ref.referenced_table != table)
+            continue;
         string sql =
             "ALTER TABLE " + ref.referencing_table + "\n"
             "    DROP CONSTRAINT " + ref.constraint_name + " CASCADE;";
         lg->detail(sql);
         { etymon::pgconn_result r(conn, sql); }
+        sql =
+            "DELETE FROM dbsystem.foreign_key_constraints\n"
+            "    WHERE referencing_table = '" + ref.referencing_table + "' AND\n"
+            "          constraint_name = '" + ref.constraint_name + "';";
+        lg->detail(sql);
+        { etymon::pgconn_result r(conn, sql); }
     }
-    string sql = "DELETE FROM dbsystem.foreign_key_constraints;";
-    lg->detail(sql);
-    { etymon::pgconn_result r(conn, sql); }
 }
 
 void select_enabled_foreign_keys(etymon::pgconn* conn, ldp_log* lg,
@@ -178,145 +313,385 @@ void make_foreign_key_constraint_name(const string& referencing_table,
     *constraint_name = string(p) + "_" + referencing_column + "_fk";
 }
 
-void log_foreign_key_warnings(const reference& ref,
+// Rows of the referencing table whose foreign key is not null and is not
+// present in the referenced table, as the tail of a query.
+static void foreign_key_exceptions_sql(const reference& ref, string* sql)
+{
+    *sql =
+        "    FROM " + ref.referencing_table + " AS r2\n"
+        "    WHERE r2.\"" + ref.referencing_column + "\" IS NOT NULL AND\n"
+        "          NOT EXISTS (\n"
+        "              SELECT 1\n"
+        "                  FROM " + ref.referenced_table + " AS r1\n"
+        "                  WHERE r1.\"" + ref.referenced_column + "\" =\n"
+        "                        r2.\"" + ref.referencing_column + "\"\n"
+        "          )";
+}
+
+/**
+ * \brief Reports and optionally deletes the rows that violate a foreign
+ * key.
+ *
+ * If rows are deleted, the rows reported are those returned by the
+ * DELETE statement, so that they are exactly the rows deleted.
+ */
+static void check_foreign_key(const reference& ref,
+                              bool enable_foreign_key_warnings,
                               bool force_foreign_key_constraints,
                               etymon::pgconn* conn, ldp_log* lg)
 {
+    string exceptions;
+    foreign_key_exceptions_sql(ref, &exceptions);
     string sql;
-    try {
+    if (force_foreign_key_constraints) {
         sql =
-            "SELECT referencing_pkey,\n"
-            "       referencing_fkey\n"
-            "    FROM temp_foreign_key_exceptions;";
-        lg->detail(sql);
-        etymon::pgconn_result r(conn, sql);
-        int total = PQntuples(r.result);
-        for (int x = 0; x < total; x++) {
-            string pkey, fkey;
-            pkey = PQgetvalue(r.result, x, 0);
-            fkey = PQgetvalue(r.result, x, 1);
-            lg->write(log_level::warning, "foreign_key", ref.referenced_table,
-                "Foreign key is not present in referenced table:\n"
-                "    Referencing table: " + ref.referencing_table + "\n"
-                "    Referencing table primary key: " + pkey + "\n"
-                "    Referencing column: " + ref.referencing_column + "\n"
-                "    Referencing column foreign key: " + fkey + "\n"
-                "    Referenced table: " + ref.referenced_table + "\n"
-                "    Referenced column: " + ref.referenced_column + "\n"
-                "    Action: " +
-                ( force_foreign_key_constraints ?
-                  "Deleting row in referencing table" : "None" ), -1 );
-        }
-        
-    } catch (runtime_error& e) {
-        string s = e.what();
-        if ( !(s.empty()) && s.back() == '\n' )
-            s.pop_back();
-        lg->detail(s);
+            "DELETE\n" + exceptions + "\n"
+            "    RETURNING r2.id,\n"
+            "              r2.\"" + ref.referencing_column + "\";";
+    } else {
+        sql =
+            "SELECT r2.id,\n"
+            "       r2.\"" + ref.referencing_column + "\"\n" +
+            exceptions + ";";
+    }
+    lg->detail(sql);
+    etymon::pgconn_result r(conn, sql);
+    if (!enable_foreign_key_warnings)
+        return;
+    int total = PQntuples(r.result);
+    for (int x = 0; x < total; x++) {
+        string pkey, fkey;
+        pkey = PQgetvalue(r.result, x, 0);
+        fkey = PQgetvalue(r.result, x, 1);
+        lg->write(log_level::warning, "foreign_key", ref.referenced_table,
+            "Foreign key is not present in referenced table:\n"
+            "    Referencing table: " + ref.referencing_table + "\n"
+            "    Referencing table primary key: " + pkey + "\n"
+            "    Referencing column: " + ref.referencing_column + "\n"
+            "    Referencing column foreign key: " + fkey + "\n"
+            "    Referenced table: " + ref.referenced_table + "\n"
+            "    Referenced column: " + ref.referenced_column + "\n"
+            "    Action: " +
+            ( force_foreign_key_constraints ?
+              "Deleted row in referencing table" : "None" ), -1 );
     }
 }
 
-void process_foreign_keys(const ldp_options& opt, bool enable_foreign_key_warnings, bool force_foreign_key_constraints, etymon::pgconn* conn, ldp_log* lg)
+/**
+ * \brief Reports and optionally deletes rows that violate a group of
+ * foreign keys.
+ *
+ * The references are checked one after another on the same connection.
+ */
+static void check_foreign_key_group(const vector<reference>& refs,
+                                    bool enable_foreign_key_warnings,
+                                    bool force_foreign_key_constraints,
+                                    etymon::pgconn* conn, ldp_log* lg)
 {
-    vector<reference> refs;
-    select_enabled_foreign_keys(conn, lg, &refs);
     for (auto& ref : refs) {
         try {
-            string sql =
-                "CREATE TEMPORARY TABLE temp_foreign_key_exceptions AS\n"
-                "SELECT id AS referencing_pkey,\n"
-                "       \"" + ref.referencing_column + "\"\n"
-                "               AS referencing_fkey\n"
-                "    FROM " + ref.referencing_table + "\n"
-                "    WHERE \"" + ref.referencing_column + "\"\n"
-                "    NOT IN (\n"
-                "        SELECT \"" + ref.referenced_column + "\"\n"
-                "            FROM " + ref.referenced_table + "\n"
-                "    );";
-            lg->detail(sql);
-            { etymon::pgconn_result r(conn, sql); }
-            sql =
-                "CREATE INDEX ON temp_foreign_key_exceptions\n"
-                "    (referencing_fkey);";
-            lg->detail(sql);
-            { etymon::pgconn_result r(conn, sql); }
-            sql = "VACUUM ANALYZE temp_foreign_key_exceptions;";
-            lg->detail(sql);
-            { etymon::pgconn_result r(conn, sql); }
-            // sql = "ANALYZE temp_foreign_key_exceptions;";
-            // lg->detail(sql);
-            // { etymon::pgconn_result r(conn, sql); }
+            check_foreign_key(ref, enable_foreign_key_warnings,
+                              force_foreign_key_constraints, conn, lg);
         } catch (runtime_error& e) {
             string s = e.what();
             if ( !(s.empty()) && s.back() == '\n' )
                 s.pop_back();
             lg->detail(s);
         }
+    }
+}
 
-        if (enable_foreign_key_warnings)
-            log_foreign_key_warnings(ref, force_foreign_key_constraints, conn,
-                                     lg);
-
-        if (force_foreign_key_constraints) {
-            string sql;
-            try {
-                sql =
-                    "DELETE\n"
-                    "    FROM " + ref.referencing_table + "\n"
-                    "    WHERE \"" + ref.referencing_column + "\"\n"
-                    "    IN (\n"
-                    "        SELECT referencing_fkey\n"
-                    "            FROM temp_foreign_key_exceptions\n"
-                    "    );";
-                lg->detail(sql);
-                { etymon::pgconn_result r(conn, sql); }
-            } catch (runtime_error& e) {
-                string s = e.what();
-                if ( !(s.empty()) && s.back() == '\n' )
-                    s.pop_back();
-                lg->detail(s);
+/**
+ * \brief Orders references so that rows are deleted from a table only
+ * after rows have been deleted from the tables it references.
+ *
+ * Deleting rows from a table can leave rows of the tables that
+ * reference it without a referenced row, and so those tables are
+ * checked later.  Tables in a cycle of references are ordered by name.
+ */
+static void order_foreign_keys_for_delete(vector<reference>* refs)
+{
+    map<string,set<string>> referenced;
+    for (auto& ref : *refs) {
+        set<string>& r = referenced[ref.referencing_table];
+        if (ref.referenced_table != ref.referencing_table)
+            r.insert(ref.referenced_table);
+    }
+    map<string,size_t> position;
+    while (position.size() < referenced.size()) {
+        // The first table that does not reference an unordered table, or
+        // the first unordered table if all are in cycles.
+        string next;
+        for (auto& [table, tables] : referenced) {
+            if (position.find(table) != position.end())
+                continue;
+            if (next == "")
+                next = table;
+            bool ready = true;
+            for (auto& t : tables) {
+                if (referenced.find(t) != referenced.end() &&
+                        position.find(t) == position.end()) {
+                    ready = false;
+                    break;
+                }
+            }
+            if (ready) {
+                next = table;
+                break;
             }
         }
+        size_t p = position.size();
+        position[next] = p;
+    }
+    stable_sort(refs->begin(), refs->end(),
+                [&](const reference& r1, const reference& r2) {
+                    return position[r1.referencing_table] <
+                        position[r2.referencing_table];
+                });
+}
 
-        string sql = "DROP TABLE IF EXISTS temp_foreign_key_exceptions;";
-        lg->detail(sql);
-        { etymon::pgconn_result r(conn, sql); }
-
-        if (!force_foreign_key_constraints)
+// Sends the commands in a batch, logging any that fail.
+static void execute_logged(etymon::pgconn_batch* batch, ldp_log* lg)
+{
+    vector<string> errors;
+    batch->execute(&errors);
+    for (auto& e : errors) {
+        if (e == "")
             continue;
-        
-        string constraint_name;
-        make_foreign_key_constraint_name(ref.referencing_table,
-                ref.referencing_column, &constraint_name);
+        string s = e;
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        lg->detail(s);
+    }
+}
+
+/**
+ * \brief Checks enabled foreign keys, and creates constraints for them
+ * if force_foreign_key_constraints is set.
+ *
+ * If rows are only reported, references to the same table are grouped,
+ * so that the referenced table's key index is read into memory once for
+ * the group, and the groups are checked concurrently, using up to
+ * update_workers connections.  If rows are deleted, the references are
+ * checked one at a time, ordered by order_foreign_keys_for_delete(),
+ * since deleting rows from one table can change the result of checking
+ * another.
+ * Constraints are then added without validation, one at a time since
+ * adding them locks both tables, and are validated concurrently.  A
+ * constraint that fails validation is removed.
+ *
+ * \param[in] tables If not null, only foreign keys from or to these
+ * tables are processed, since the constraints of other tables were not
+ * removed.
+ */
+void process_foreign_keys(const ldp_options& opt, bool enable_foreign_key_warnings, bool force_foreign_key_constraints, const set<string>* tables, etymon::pgconn_pool* conn_pool, etymon::pgconn* conn, ldp_log* lg)
+{
+    vector<reference> refs;
+    select_enabled_foreign_keys(conn, lg, &refs);
+    if (tables != nullptr) {
+        refs.erase(remove_if(refs.begin(), refs.end(), [&](const reference& ref) {
+                       return tables->find(ref.referencing_table) == tables->end() &&
+                           tables->find(ref.referenced_table) == tables->end();
+                   }), refs.end());
+    }
+    if (refs.empty())
+        return;
+
+    map<string, vector<reference>> group_map;
+    if (force_foreign_key_constraints) {
+        order_foreign_keys_for_delete(&refs);
+        group_map[""] = refs;
+    } else {
+        for (auto& ref : refs)
+            group_map[ref.referenced_table].push_back(ref);
+    }
+    vector<const vector<reference>*> groups;
+    for (auto& [table, group] : group_map)
+        groups.push_back(&group);
+
+    atomic<size_t> next(0);
+    auto check_groups = [&]() {
         try {
-            string sql =
-                "ALTER TABLE " + ref.referencing_table + "\n"
-                "    ADD CONSTRAINT\n"
-                "    " + constraint_name + "\n"
-                "    FOREIGN KEY (\"" + ref.referencing_column + "\")\n"
-                "    REFERENCES " + ref.referenced_table + " (" +
-                ref.referenced_column + ");";
-            lg->detail(sql);
-            { etymon::pgconn_result r(conn, sql); }
-            sql =
-                "INSERT INTO dbsystem.foreign_key_constraints\n"
-                "    (referencing_table, referencing_column,\n"
-                "     referenced_table, referenced_column, constraint_name)\n"
-                "    VALUES\n"
-                "    ('" + ref.referencing_table + "',\n"
-                "     '" + ref.referencing_column + "',\n"
-                "     '" + ref.referenced_table + "',\n"
-                "     '" + ref.referenced_column + "',\n"
-                "     '" + constraint_name + "');";
-            lg->detail(sql);
-            { etymon::pgconn_result r(conn, sql); }
+            etymon::pgconn_lease c(conn_pool);
+            while (true) {
+                size_t x = next++;
+                if (x >= groups.size())
+                    break;
+                check_foreign_key_group(*groups[x], enable_foreign_key_warnings,
+                                        force_foreign_key_constraints, c.conn,
+                                        lg);
+            }
         } catch (runtime_error& e) {
             string s = e.what();
+            if ( !(s.empty()) && s.back() == '\n' )
+                s.pop_back();
+            lg->write(log_level::warning, "server", "", "unable to connect to database: " + s, -1);
+        }
+    };
+    size_t workers = min((size_t) opt.update_workers, groups.size());
+    vector<thread> threads;
+    for (size_t x = 0; x < workers; x++)
+        threads.push_back(thread(check_groups));
+    for (auto& t : threads)
+        t.join();
+    if (next < groups.size())
+        lg->write(log_level::error, "server", "", "foreign keys not checked: no database connection available", -1);
+
+    if (!force_foreign_key_constraints)
+        return;
+
+    vector<string> constraint_names;
+    etymon::pgconn_batch batch(conn);
+    for (auto& ref : refs) {
+        string constraint_name;
+        make_foreign_key_constraint_name(ref.referencing_table,
+                ref.referencing_column, &constraint_name);
+        constraint_names.push_back(constraint_name);
+        string sql =
+            "ALTER TABLE " + ref.referencing_table + "\n"
+            "    ADD CONSTRAINT\n"
+            "    " + constraint_name + "\n"
+            "    FOREIGN KEY (\"" + ref.referencing_column + "\")\n"
+            "    REFERENCES " + ref.referenced_table + " (" +
+            ref.referenced_column + ")\n"
+            "    NOT VALID;";
+        lg->detail(sql);
+        batch.add(sql);
+    }
+    vector<string> errors;
+    batch.execute(&errors);
+
+    vector<sql_task> tasks;
+    vector<size_t> task_refs;
+    for (size_t x = 0; x < refs.size(); x++) {
+        auto& ref = refs[x];
+        if (errors[x] != "") {
+            string s = errors[x];
             if ( !(s.empty()) && s.back() == '\n' )
                 s.pop_back();
             lg->detail(s);
+            continue;
+        }
+        string sql =
+            "INSERT INTO dbsystem.foreign_key_constraints\n"
+            "    (referencing_table, referencing_column,\n"
+            "     referenced_table, referenced_column, constraint_name)\n"
+            "    VALUES\n"
+            "    ('" + ref.referencing_table + "',\n"
+            "     '" + ref.referencing_column + "',\n"
+            "     '" + ref.referenced_table + "',\n"
+            "     '" + ref.referenced_column + "',\n"
+            "     '" + constraint_names[x] + "');";
+        lg->detail(sql);
+        batch.add(sql);
+        sql =
+            "ALTER TABLE " + ref.referencing_table + "\n"
+            "    VALIDATE CONSTRAINT " + constraint_names[x] + ";";
+        lg->detail(sql);
+        tasks.push_back(sql_task(ref.referencing_table, sql));
+        task_refs.push_back(x);
+    }
+    execute_logged(&batch, lg);
+
+    vector<string> warnings;
+    run_sql_tasks(opt.dbinfo, vector<string>(), opt.update_workers, &tasks,
+                  &warnings);
+    for (auto& w : warnings)
+        lg->write(log_level::warning, "server", "", w, -1);
+    for (size_t x = 0; x < tasks.size(); x++) {
+        if (tasks[x].ok)
+            continue;
+        auto& ref = refs[task_refs[x]];
+        const string& constraint_name = constraint_names[task_refs[x]];
+        lg->write(log_level::warning, "foreign_key", ref.referenced_table,
+                  "unable to validate foreign key constraint " +
+                  constraint_name + ": " + tasks[x].error, -1);
+        string sql =
+            "ALTER TABLE " + ref.referencing_table + "\n"
+            "    DROP CONSTRAINT " + constraint_name + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql =
+            "DELETE FROM dbsystem.foreign_key_constraints\n"
+            "    WHERE referencing_table = '" + ref.referencing_table + "' AND\n"
+            "          constraint_name = '" + constraint_name + "';";
+        lg->detail(sql);
+        batch.add(sql);
+    }
+    execute_logged(&batch, lg);
+}
+
+/**
+ * \brief Places the child tables of a table's arrays, and registers
+ * them in dbsystem.tables.
+ *
+ * Child tables of arrays that are no longer listed for the table are
+ * dropped, together with their rows in dbsystem.tables.
+ */
+static void place_array_tables(const ldp_options& opt, ldp_log* lg,
+                               const table_schema& table,
+                               etymon::pgconn* conn, const dbtype& dbt)
+{
+    // Child table names begin with the table name followed by "__".
+    string pattern;
+    for (auto c : table.name) {
+        if (c == '_')
+            pattern += "\\";
+        pattern += c;
+    }
+    pattern += "\\_\\_%";
+
+    string sql =
+        "SELECT tablename\n"
+        "    FROM pg_tables\n"
+        "    WHERE schemaname = 'public' AND\n"
+        "          tablename LIKE '" + pattern + "';";
+    lg->detail(sql);
+    vector<string> existing;
+    {
+        etymon::pgconn_result r(conn, sql);
+        int total = PQntuples(r.result);
+        for (int x = 0; x < total; x++)
+            existing.push_back(PQgetvalue(r.result, x, 0));
+    }
+    for (auto& name : existing) {
+        bool listed = false;
+        for (auto& array : table.arrays) {
+            if (array.name == name)
+                listed = true;
+        }
+        if (!listed) {
+            lg->trace(table.name + ": removing array table: " + name);
+            drop_table(opt, lg, name, conn);
         }
     }
+
+    for (auto& array : table.arrays) {
+        table_schema child;
+        child.name = array.name;
+        drop_table(opt, lg, child.name, conn);
+        place_table(opt, lg, child, conn);
+    }
+
+    sql =
+        "DELETE FROM dbsystem.tables\n"
+        "    WHERE table_name LIKE '" + pattern + "';";
+    lg->detail(sql);
+    { etymon::pgconn_result r(conn, sql); }
+    for (auto& array : table.arrays) {
+        sql =
+            "INSERT INTO dbsystem.tables\n"
+            "    (table_name, updated, row_count, documentation,\n"
+            "     documentation_url)\n"
+            "    VALUES\n"
+            "    ('" + array.name + "',\n"
+            "     " + string(dbt.current_timestamp()) + ",\n"
+            "     " + to_string(array.row_count) + ",\n"
+            "     'Array " + array.path + " of " + table.name + "',\n"
+            "     'https://dev.folio.org/reference/api/#" + table.module_name + "');";
+        lg->detail(sql);
+        { etymon::pgconn_result r(conn, sql); }
+    }
 }
 
 void select_config_general(etymon::pgconn* conn, ldp_log* lg,
@@ -339,101 +714,289 @@ void select_config_general(etymon::pgconn* conn, ldp_log* lg,
     *enable_foreign_key_warnings = (s3 == "t");
 }
 
-bool stage_merge(const ldp_options& opt, ldp_log* lg, table_schema* table, const vector<source_state>& source_states, const string& load_dir,
-    field_set* drop_fields, vector<string>* users, bool lz4)
+// Marks the tables that are enabled in dbconfig.data_indexes.
+static void select_data_indexes(etymon::pgconn* conn, ldp_log* lg,
+                                ldp_schema* schema)
 {
-    etymon::pgconn conn(opt.dbinfo);
-    dbtype dbt(&conn);
+    string sql =
+        "SELECT table_name\n"
+        "    FROM dbconfig.data_indexes\n"
+        "    WHERE enable_index = TRUE;";
+    lg->detail(sql);
+    etymon::pgconn_result r(conn, sql);
+    int total = PQntuples(r.result);
+    for (int x = 0; x < total; x++) {
+        string table_name = PQgetvalue(r.result, x, 0);
+        bool found = false;
+        for (auto& table : schema->tables) {
+            if (table.name == table_name) {
+                table.data_index = true;
+                found = true;
+            }
+        }
+        if (!found)
+            lg->write(log_level::warning, "server", "", "unknown table in dbconfig.data_indexes: " + table_name, -1);
+    }
+}
+
+static bool select_current_wal_lsn(etymon::pgconn* conn, ldp_log* lg, string* lsn)
+{
+    string sql = "SELECT pg_current_wal_lsn();";
+    lg->detail(sql);
+    try {
+        etymon::pgconn_result r(conn, sql);
+        *lsn = PQgetvalue(r.result, 0, 0);
+        return true;
+    } catch (runtime_error& e) {
+        return false;
+    }
+}
+
+// The difference in WAL position includes any concurrent activity on the
+// server, such as other tables being updated in parallel.
+static void log_wal_bytes(etymon::pgconn* conn, ldp_log* lg, const string& table_name, const string& start_lsn)
+{
+    string sql = "SELECT pg_wal_lsn_diff(pg_current_wal_lsn(), '" + start_lsn + "')::bigint;";
+    lg->detail(sql);
+    string wal_bytes;
+    try {
+        etymon::pgconn_result r(conn, sql);
+        wal_bytes = PQgetvalue(r.result, 0, 0);
+    } catch (runtime_error& e) {
+        return;
+    }
+    lg->write(log_level::debug, "wal", table_name, table_name + ": WAL bytes written on server during update: " + wal_bytes, -1);
+}
+
+static bool extracted_files_exist(const string& load_dir,
+                                  const table_schema& table,
+                                  const vector<source_state>& source_states)
+{
+    for (auto& state : source_states) {
+        string count_file = load_dir;
+        etymon::join(&count_file, table.name);
+        count_file += "_" + state.source.source_name;
+        count_file += "_count.txt";
+        if (!fs::exists(count_file))
+            return false;
+    }
+    return true;
+}
+
+// Saves the ids of a placed table for foreign key detection.
+static void write_id_summary(const ldp_options& opt, ldp_log* lg,
+                             const table_schema& table, const id_summary& ids)
+{
+    string dir, path;
+    id_summary_dir(opt, &dir);
+    id_summary_path(dir, table.name, &path);
+    try {
+        fs::create_directories(dir);
+        ids.write(path);
+    } catch (exception& e) {
+        lg->write(log_level::warning, "update", table.name, table.name + ": unable to write id summary: " + e.what(), -1);
+    }
+}
+
+bool stage_merge(const ldp_options& opt, ldp_log* lg, stage_session* session, table_schema* table, const vector<source_state>& source_states,
+    const string& load_dir, field_set* drop_fields, vector<string>* users, bool lz4, bool track_progress,
+    vector<phase_metrics>* metrics)
+{
+    timer stage_merge_timer;
+    etymon::pgconn* conn = session->connection();
+    dbtype dbt(conn);
+
+    string start_lsn;
+    bool wal_available = select_current_wal_lsn(conn, lg, &start_lsn);
 
     if (opt.record_history) {
         lg->trace(table->name + ": writing latest history");
-        create_latest_history_table(opt, lg, *table, &conn);
+        create_latest_history_table(opt, lg, *table, conn);
     }
 
+    size_t record_count = 0;
+    size_t history_record_count = 0;
+    id_summary ids;
+    int64_t data_bytes = data_file_bytes(opt, source_states, lg, *table, load_dir);
+    phase_timer phase;
     {
-        char* read_buffer = (char*) malloc(varchar_size);
-        etymon::malloc_ptr read_buffer_ptr(read_buffer);
+        char* read_buffer = session->read_buffer;
 
-        { etymon::pgconn_result r(&conn, "BEGIN;"); }
+        // The schema inferred in the previous update is used if the data
+        // still conform to it, which avoids a separate pass to infer it.
+        vector<column_schema> cached_columns;
+        size_t cached_count = 0;
+        try {
+            select_cached_schema(conn, lg, *table, *drop_fields, opt.flatten_depth, &cached_columns, &cached_count);
+        } catch (runtime_error& e) {
+            lg->trace(table->name + ": unable to read cached schema");
+        }
 
-        lg->trace(table->name + ": staging pass 1");
-        bool ok = stage_table_1(opt, source_states, lg, table, &conn, &dbt, load_dir, drop_fields, read_buffer, users, lz4);
-        if (!ok) {
-            return false;
+        { etymon::pgconn_result r(conn, "BEGIN;"); }
+
+        bool staged = false;
+        if (cached_columns.size() > 0) {
+            lg->trace(table->name + ": staging with cached schema");
+            table->columns = cached_columns;
+            // Allow for growth since the schema was cached.
+            ids.ids.init(cached_count + cached_count / 4);
+            staged = stage_table_with_schema(opt, source_states, lg, table, conn, &dbt, load_dir, drop_fields, read_buffer, users, lz4, "cached", &record_count, &ids);
+            phase.stop("load", record_count, data_bytes, metrics);
+            if (!staged)
+                ids = id_summary();
         }
 
-        lg->trace(table->name + ": staging pass 2");
-        ok = stage_table_2(opt, source_states, lg, table, &conn, &dbt, load_dir, drop_fields, read_buffer);
-        if (!ok) {
-            return false;
+        // If the table could not be staged with the cached schema, the
+        // schema is inferred from all of the data.
+        size_t sample_size = (cached_columns.size() > 0) ? 0 : opt.inference_sample_size;
+        while (!staged) {
+            lg->trace(table->name + ": staging pass 1");
+            size_t analyzed_count = 0;
+            bool sampled = false;
+            bool ok = stage_table_1(opt, source_states, lg, table, conn, &dbt, load_dir, drop_fields, read_buffer, users, lz4, sample_size, &analyzed_count, &sampled);
+            if (!ok) {
+                return false;
+            }
+            phase.stop("analyze", analyzed_count, sampled ? -1 : data_bytes, metrics);
+            ids.ids.init(analyzed_count);
+
+            if (sampled) {
+                lg->trace(table->name + ": staging with sampled schema");
+                staged = stage_table_with_schema(opt, source_states, lg, table, conn, &dbt, load_dir, drop_fields, read_buffer, users, lz4, "sampled", &record_count, &ids);
+                phase.stop("load", record_count, data_bytes, metrics);
+                if (!staged) {
+                    ids = id_summary();
+                    sample_size = 0;
+                }
+                continue;
+            }
+
+            lg->trace(table->name + ": staging pass 2");
+            ok = stage_table_2(opt, source_states, lg, table, conn, &dbt, load_dir, drop_fields, read_buffer, &record_count, &ids);
+            if (!ok) {
+                return false;
+            }
+            phase.stop("load", record_count, data_bytes, metrics);
+            staged = true;
         }
+        // Staging and merging are recorded outside of the transaction, so
+        // that they are visible while it is in progress.
+        if (track_progress)
+            session->record_progress(lg, table->name, "staged");
 
         if (opt.record_history && table->source_type != data_source_type::srs_marc_records && table->source_type != data_source_type::srs_records &&
             table->source_type != data_source_type::srs_error_records) {
             lg->write(log_level::trace, "", "", table->name + ": merging", -1);
-            merge_table(opt, lg, *table, &conn, dbt);
+            phase.restart();
+            merge_table(opt, lg, *table, conn, dbt, &history_record_count);
+            phase.stop("merge", history_record_count, -1, metrics);
+            if (track_progress)
+                session->record_progress(lg, table->name, "merged");
         }
 
-        remove_foreign_key_constraints(&conn, lg);
-        drop_table(opt, lg, table->name, &conn);
+        phase.restart();
+        remove_foreign_key_constraints(conn, lg, table->name);
+        drop_table(opt, lg, table->name, conn);
 
-        place_table(opt, lg, *table, &conn);
+        place_table(opt, lg, *table, conn);
+        place_array_tables(opt, lg, *table, conn, dbt);
 
         lg->trace(table->name + ": committing changes");
-        { etymon::pgconn_result r(&conn, "COMMIT;"); }
+        { etymon::pgconn_result r(conn, "COMMIT;"); }
+        phase.stop("place", record_count, -1, metrics);
     }
-
-    add_pkey_and_indexes(lg, *table, &conn, &dbt, opt.all_indexes);
+    write_id_summary(opt, lg, *table, ids);
+    if (track_progress)
+        record_update_progress(conn, lg, table->name, "placed");
+    record_column_stats(lg, *table, conn);
+    save_cached_schema(conn, lg, *table, *drop_fields, opt.flatten_depth, record_count);
+
+    // The GIN index on data is built in the background, and is waited
+    // for just before the table's update is recorded.
+    unique_ptr<data_index_build> data_index;
+    if (table->data_index && dbt.type() == dbsys::postgresql)
+        data_index.reset(new data_index_build(opt, *table));
+    phase.restart();
+    add_pkey_and_indexes(opt, lg, *table, conn, &dbt, data_index.get());
+    phase.stop("index", -1, -1, metrics);
 
     if (opt.record_history) {
-        drop_latest_history_table(opt, lg, *table, &conn);
+        drop_latest_history_table(opt, lg, *table, conn);
     }
 
-    string sql =
-        "SELECT COUNT(*) FROM\n"
-        "    " + table->name + ";";
-    lg->detail(sql);
-    string row_count;
-    {
-        etymon::pgconn_result r(&conn, sql);
-        row_count = PQgetvalue(r.result, 0, 0);
+    if (wal_available)
+        log_wal_bytes(conn, lg, table->name, start_lsn);
+
+    // Row counts are taken from the number of records staged and added to
+    // history, rather than scanning the tables.  The history row count is
+    // maintained incrementally; if it has not been recorded before, it is
+    // initialized from the planner's estimate, or counted if the history
+    // table has never been analyzed.  Before PostgreSQL 14 reltuples is 0
+    // rather than -1 for a table that has never been analyzed, so the
+    // estimate is used only if it and relpages are positive; an empty
+    // table is counted, which is inexpensive.
+    string history_rows = to_string(history_record_count);
+    string data_index_time_str = "NULL";
+    string data_index_size = "NULL";
+    double data_index_time;
+    if (data_index && data_index->wait(lg, &data_index_time)) {
+        char elapsed[255];
+        sprintf(elapsed, "%.3f", data_index_time);
+        data_index_time_str = elapsed;
+        string index_name;
+        data_index_name(table->name, &index_name);
+        data_index_size = "pg_relation_size('" + index_name + "'::regclass)";
     }
-    sql =
-        "SELECT COUNT(*) FROM\n"
-        "    history." + table->name + ";";
-    lg->detail(sql);
-    string history_row_count;
-    {
-        etymon::pgconn_result r(&conn, sql);
-        history_row_count = PQgetvalue(r.result, 0, 0);
-    }
-    sql =
+    string sql =
         "UPDATE dbsystem.tables\n"
         "    SET updated = " + string(dbt.current_timestamp()) + ",\n"
-        "        row_count = " + row_count + ",\n"
-        "        history_row_count = " + history_row_count + ",\n"
+        "        row_count = " + to_string(record_count) + ",\n"
+        "        history_row_count =\n"
+        "            CASE WHEN history_row_count IS NOT NULL\n"
+        "                     THEN history_row_count + " + history_rows + "\n"
+        "                 WHEN c.reltuples > 0 AND c.relpages > 0\n"
+        "                     THEN c.reltuples::bigint + " + history_rows + "\n"
+        "                 ELSE (SELECT COUNT(*) FROM history." + table->name + ")\n"
+        "            END,\n"
         "        documentation = '" + table->source_spec + " in "
         + table->module_name + "',\n"
         "        documentation_url = 'https://dev.folio.org/reference/api/#"
-        + table->module_name + "'\n"
-        "    WHERE table_name = '" + table->name + "';";
+        + table->module_name + "',\n"
+        "        data_index_time = " + data_index_time_str + ",\n"
+        "        data_index_size = " + data_index_size + "\n"
+        "    FROM pg_class AS c\n"
+        "    WHERE table_name = '" + table->name + "' AND\n"
+        "          c.oid = 'history." + table->name + "'::regclass;";
     lg->detail(sql);
-    { etymon::pgconn_result r(&conn, sql); }
+    { etymon::pgconn_result r(conn, sql); }
+
+    record_table_metrics(conn, lg, table->name, *metrics);
+
+    if (track_progress)
+        record_update_progress(conn, lg, table->name, "indexed");
+
+    // The elapsed time is read back by select_table_costs() to schedule
+    // the next update.
+    lg->write(log_level::debug, "update", table->name, table->name + ": updated", stage_merge_timer.elapsed_time());
 
     return true;
 }
 
 void run_stage_merge(const ldp_options& opt, ldp_log* lg, table_schema* table, const vector<source_state>& source_states,
-    const string& load_dir, field_set* drop_fields, vector<string>* users, bool lz4)
+    const string& load_dir, field_set* drop_fields, vector<string>* users, bool lz4, bool track_progress,
+    vector<phase_metrics>* metrics)
 {
     try {
-        stage_merge(opt, lg, table, source_states, load_dir, drop_fields, users, lz4);
+        stage_session session(opt.dbinfo);
+        stage_merge(opt, lg, &session, table, source_states, load_dir, drop_fields, users, lz4, track_progress, metrics);
+        lg->flush();
         exit(0);
     } catch (runtime_error& e) {
         string s = e.what();
         if ( !(s.empty()) && s.back() == '\n' ) {
             s.pop_back();
         }
+        lg->flush();
         etymon::pgconn log_conn(opt.dbinfo);
         ldp_log lg(&log_conn, opt.lg_level, opt.console, opt.quiet);
         lg.write(log_level::error, "server", "", s, -1);
@@ -441,30 +1004,13 @@ void run_stage_merge(const ldp_options& opt, ldp_log* lg, table_schema* table, c
     }
 }
 
-bool wait_stage_merge(pid_t pid, const string& table_name, ldp_log* log)
+void check_for_views(etymon::pgconn_pool* conn_pool, ldp_log* lg)
 {
-    if (pid > 0) {
-        int stat;
-        waitpid(pid, &stat, 0);
-        if (WIFEXITED(stat)) {
-            //log->write(log_level::trace, "", "", table_name + ": exit status: " + to_string(WEXITSTATUS(stat)), -1);
-            //log->write(log_level::trace, "", "", table_name + ": normal exit", -1);
-            return true;
-        } else {
-            log->write(log_level::trace, "", "", table_name + ": exit status: " + to_string(WEXITSTATUS(stat)), -1);
-            return false;
-        }
-    }
-    return true;
-}
-
-void check_for_views(const ldp_options& opt, ldp_log* lg)
-{
-    etymon::pgconn conn(opt.dbinfo);
+    etymon::pgconn_lease conn(conn_pool);
     string sql = "SELECT 1 FROM information_schema.views WHERE table_schema NOT IN ('pg_catalog','information_schema') LIMIT 1;";
     lg->detail(sql);
     try {
-        etymon::pgconn_result r(&conn, sql);
+        etymon::pgconn_result r(conn.conn, sql);
         if (PQntuples(r.result) > 0) {
             lg->write(log_level::warning, "server", "", "database contains views, which may cause updates to fail", -1);
         }
@@ -473,20 +1019,20 @@ void check_for_views(const ldp_options& opt, ldp_log* lg)
     }
 }
 
-bool is_lz4_available(const etymon::pgconn_info* dbinfo)
+bool is_lz4_available(etymon::pgconn_pool* conn_pool)
 {
-    etymon::pgconn conn(*dbinfo);
-    string q = "CREATE TEMP TABLE lz4test (c text COMPRESSION lz4);";
+    // The test table is created in a transaction that is rolled back, so
+    // that the pooled connection is left unchanged.
+    etymon::pgconn_lease conn(conn_pool);
+    { etymon::pgconn_result r(conn.conn, "BEGIN;"); }
+    bool available = true;
     try {
-        { etymon::pgconn_result r(&conn, q); }
+        etymon::pgconn_result r(conn.conn, "CREATE TEMP TABLE lz4test (c text COMPRESSION lz4);");
     } catch (runtime_error& e) {
-        return false;
+        available = false;
     }
-    q = "DROP TABLE lz4test;";
-    try {
-        { etymon::pgconn_result r(&conn, q); }
-    } catch (runtime_error& e) {}
-    return true;
+    { etymon::pgconn_result r(conn.conn, "ROLLBACK;"); }
+    return available;
 }
 
 void run_update(const ldp_options& opt, bool update_users)
@@ -498,7 +1044,9 @@ void run_update(const ldp_options& opt, bool update_users)
                             curl_easy_strerror(cc));
     }
 
-    ldp_log lg(opt.lg_level, opt.console, opt.quiet, &(opt.dbinfo));
+    // Connections for the log and for short queries are reused.
+    etymon::pgconn_pool conn_pool(opt.dbinfo, 2);
+    ldp_log lg(opt.lg_level, opt.console, opt.quiet, &conn_pool);
 
     vector<string> users;
     bool ok = read_users(opt, &lg, &users, update_users);
@@ -515,18 +1063,57 @@ void run_update(const ldp_options& opt, bool update_users)
     //    lg.write(log_level::info, "server", "", "parallel vacuum is disabled", -1);
     //}
 
-    lg.write(log_level::debug, "server", "", "starting update", -1);
+    if (opt.scheduled_tables.empty()) {
+        lg.write(log_level::debug, "server", "", "starting update", -1);
+    } else {
+        string tables;
+        for (auto& t : opt.scheduled_tables)
+            tables += (tables == "" ? "" : ", ") + t;
+        lg.write(log_level::debug, "server", "", "starting scheduled update: " + tables, -1);
+    }
     timer full_update_timer;
 
+    metrics_file metrics(opt);
+    {
+        etymon::pgconn_lease conn(&conn_pool);
+        metrics.start_update(conn.conn, &lg);
+        metrics.write(conn.conn, &lg);
+    }
+
     lg.write(log_level::detail, "", "", "okapi timeout: " + to_string(opt.okapi_timeout), -1);
 
-    check_for_views(opt, &lg);
+    check_for_views(&conn_pool, &lg);
 
-    bool lz4 = is_lz4_available(&opt.dbinfo);
+    bool lz4 = is_lz4_available(&conn_pool);
 
     ldp_schema schema;
     ldp_schema::make_default_schema(&schema);
 
+    // An interrupted full update is resumed, skipping tables that were
+    // completely updated.  If temporary files are retained, files that
+    // were already extracted are reused.
+    bool track_progress = (opt.table == "" && opt.scheduled_tables.empty());
+    map<string,string> progress;
+    if (track_progress) {
+        etymon::pgconn_lease conn(&conn_pool);
+        select_update_progress(conn.conn, &lg, opt.resume_max_age, &progress);
+    }
+    bool reuse_files = (progress.size() > 0 && opt.savetemps);
+    if (progress.size() > 0)
+        lg.write(log_level::info, "server", "", "resuming interrupted update", -1);
+
+    // In server mode, a full update skips tables that have their own
+    // schedules and are not due.  The schedules of tables that are due
+    // are advanced, since those tables are updated now.
+    set<string> not_due;
+    if (!opt.cli_mode && opt.table == "" && opt.scheduled_tables.empty()) {
+        etymon::pgconn_lease conn(&conn_pool);
+        vector<string> tables;
+        select_tables_not_due(conn.conn, &lg, &tables);
+        not_due.insert(tables.begin(), tables.end());
+        select_due_tables(conn.conn, &lg, schema, &tables);
+    }
+
     extraction_files ext_dir(opt, &lg);
 
     string load_dir;
@@ -550,7 +1137,7 @@ void run_update(const ldp_options& opt, bool update_users)
 
             // okapi_login(opt, source, &lg, &state.token);
 
-            make_update_tmp_dir(opt, &load_dir);
+            make_update_tmp_dir(opt, &load_dir, reuse_files);
             ext_dir.dir = load_dir;
 
             source_states.push_back(state);
@@ -559,170 +1146,329 @@ void run_update(const ldp_options& opt, bool update_users)
 
     //string current_module = "";
 
-    pid_t worker_pid = 0;
-    string worker_table_name;
-    extraction_files* worker_ext_files = nullptr;
+    // Returns true if a table is updated by this run, including tables
+    // that were updated before an interrupted run that is resumed.
+    auto in_run = [&](const table_schema& table) -> bool {
+        // Skip this table if the --table option is specified and does not
+        // match this table.
+        if (opt.table != "" && opt.table != table.name)
+            return false;
 
-    for (auto& table : schema.tables) {
+        // Skip this table if this is a scheduled update and the table is
+        // not due.
+        if (!opt.scheduled_tables.empty() &&
+                find(opt.scheduled_tables.begin(), opt.scheduled_tables.end(), table.name) == opt.scheduled_tables.end())
+            return false;
 
-        try {
+        // Skip this table if this is a full update and the table has its
+        // own schedule and is not due.
+        if (not_due.find(table.name) != not_due.end())
+            return false;
 
-            // Skip this table if the --table option is specified and does not
-            // match this table.
-            if (opt.table != "" && opt.table != table.name)
-                continue;
+        // Skip this table if the entire table should be anonymized.
+        if (opt.anonymize && table.anonymize)
+            return false;
 
-            // Enable anonymization of the entire table.
-            bool anonymize_table = opt.anonymize && table.anonymize;
-            field_set drop_fields;
-            if (opt.anonymize) {
-                load_anonymize_field_list(&drop_fields);
-            }
-            read_drop_fields(opt, &lg, &drop_fields);
+        return true;
+    };
 
-            // Skip this table if the entire table should be anonymized.
-            if (anonymize_table)
-                continue;
+    // Returns true if a table is to be updated in this run.
+    auto selected = [&](const table_schema& table) -> bool {
+        if (!in_run(table))
+            return false;
 
-            //if (table.module_name != current_module) {
-            //    current_module = table.module_name;
-            //    lg.write(log_level::debug, "update", "", "module: " + current_module, -1);
-            //}
+        // Skip this table if it was updated before the previous update was
+        // interrupted.
+        auto p = progress.find(table.name);
+        if (p != progress.end() && p->second == "indexed")
+            return false;
 
-            lg.write(log_level::detail, "", "", "updating table: " + table.name, -1);
-
-            timer update_timer;
-
-            extraction_files* ext_files = new extraction_files(opt, &lg);
-
-            for (auto& state : source_states) {
-
-                curl_wrapper curlw;
-                //if (!c.curl) {
-                //    // throw?
-                //}
-                string tenant_header = "X-Okapi-Tenant: ";
-                tenant_header + state.source.okapi_tenant;
-                string token_header = "X-Okapi-Token: ";
-                token_header += state.token;
-                curlw.headers = curl_slist_append(curlw.headers,
-                                                  tenant_header.c_str());
-                curlw.headers = curl_slist_append(curlw.headers,
-                                                  token_header.c_str());
-                curlw.headers = curl_slist_append(
-                    curlw.headers, "Accept: application/json,text/plain");
-                curl_easy_setopt(curlw.curl, CURLOPT_HTTPHEADER,
-                                 curlw.headers);
-
-                if (opt.load_from_dir == "") {
-                    lg.write(log_level::debug, "update", table.name, "updating " + table.name, -1);
-                    lg.write(log_level::trace, "", "", table.name + ": reading", -1);
-                    bool found_data = false;
-                    // if (direct_override(state.source, table.name)) {
-                    //     found_data = retrieve_direct(state.source, &lg, table, load_dir, ext_files, opt.direct_extraction_no_ssl);
-                    // } else {
-                    //     if (table.source_type != data_source_type::srs_marc_records && table.source_type != data_source_type::srs_records &&
-                    //         table.source_type != data_source_type::srs_error_records && table.source_type != data_source_type::direct_only) {
-                    //         found_data = retrieve_pages(curlw, opt, state.source, &lg, state.token, table, load_dir, ext_files);
-                    //     } else {
-                    //         lg.write(log_level::debug, "", "", table.name + ": requires direct extraction", -1);
-                    //     }
-                    // }
-                    found_data = retrieve_direct(state.source, &lg, &table, load_dir, ext_files, opt.direct_extraction_no_ssl);
-
-                    if (!found_data) {
-                        lg.trace("no rows extracted, clearing table");
-                        // Clear old data from the table.
-                        {
-                            etymon::pgconn conn(opt.dbinfo);
-                            string sql = "DELETE FROM " + table.name + ";";
-                            lg.detail(sql);
-                            { etymon::pgconn_result r(&conn, sql); }
-                        }
-                        // No more processing is needed for this table.
-                        table.skip = true;
-                    }
-                    lg.trace(table.name + ": completed extraction");
-                }
-            } // for
+        return true;
+    };
+
+    // Tables that are updated by this run.  If only some tables are to
+    // be updated, processing after the tables have been updated is
+    // limited to them.
+    set<string> run_tables;
+    for (auto& table : schema.tables) {
+        if (in_run(table))
+            run_tables.insert(table.name);
+    }
+    bool partial_update = (opt.table != "" || !opt.scheduled_tables.empty() || !not_due.empty());
 
-            if (table.skip || opt.extract_only) {
-                delete ext_files;
+    // Id summaries left by a previous run may describe data that have
+    // since changed, and so the summaries of tables to be updated are
+    // removed, to be written again when the tables are staged.  The
+    // summaries of other tables still describe their data.
+    {
+        string ids_dir;
+        id_summary_dir(opt, &ids_dir);
+        for (auto& table : schema.tables) {
+            if (!selected(table))
                 continue;
-            }
+            string path;
+            id_summary_path(ids_dir, table.name, &path);
+            error_code ec;
+            fs::remove(path, ec);
+            if (ec)
+                lg.write(log_level::warning, "server", "", "unable to remove id summary: " + path + ": " + ec.message(), -1);
+        }
+    }
+
+    // Start the longest tables first, so that they do not extend the
+    // update after the other workers have finished.  Only tables that
+    // are to be updated in this run are included in the prediction.
+    bool parallel = opt.parallel_update && opt.table == "";
+    double predicted_makespan = -1;
+    if (parallel) {
+        map<string,double> costs;
+        {
+            etymon::pgconn_lease conn(&conn_pool);
+            select_table_costs(conn.conn, &lg, schema, &costs);
+        }
+        for (auto& table : schema.tables) {
+            if (!selected(table))
+                costs.erase(table.name);
+        }
+        if (costs.size() > 0) {
+            predicted_makespan = order_tables_by_cost(costs, opt.update_workers, &(schema.tables));
+            lg.write(log_level::debug, "queue", "", "ordered tables by estimated update time (" + to_string(costs.size()) + " estimated)", -1);
+        }
+    }
+    timer tables_timer;
+
+    // Fields to drop are shared read-only by all tables and workers.
+    field_set drop_fields;
+    if (opt.anonymize) {
+        load_anonymize_field_list(&drop_fields);
+    }
+    read_drop_fields(opt, &lg, &drop_fields);
+
+    // Arrays to extract into child tables, and nested fields to flatten
+    // into columns.
+    read_array_tables(opt, &lg, &schema);
+    read_flatten_fields(opt, &lg, &schema);
+    {
+        etymon::pgconn_lease conn(&conn_pool);
+        select_data_indexes(conn.conn, &lg, &schema);
+    }
 
-            if (opt.parallel_update && opt.table == "") {  // forked process
-                if (wait_stage_merge(worker_pid, worker_table_name, &lg) && worker_pid != 0) {
-                    lg.write(log_level::trace, "", worker_table_name, worker_table_name + ": completed update", -1);
-                    if (worker_ext_files) {
-                        delete worker_ext_files;
-                        worker_ext_files = nullptr;
+    // Tables are staged and merged in up to update_workers forked
+    // processes or threads, while extraction continues in this thread.
+    // At most one extracted table waits for a free worker.  Worker
+    // processes cannot be forked safely while extraction threads may
+    // be running in libpq, OpenSSL, or curl, and so config_options()
+    // allows extraction_workers only with the thread executor.
+    unique_ptr<stage_executor> pool;
+    if (opt.update_executor == update_executor_mode::thread || opt.extraction_workers > 0) {
+        pool.reset(new stage_thread_pool(&lg, opt.dbinfo, opt.update_workers, 1,
+                                         [&](stage_session* session, stage_job* job) {
+                                             stage_merge(opt, &lg, session, job->table, source_states, load_dir, job->drop_fields, &users, lz4, track_progress, &(job->metrics));
+                                         }));
+    } else {
+        pool.reset(new stage_worker_pool(&lg, opt.update_workers, 1,
+                                         [&](stage_job* job) {
+                                             run_stage_merge(opt, &lg, job->table, source_states, load_dir, job->drop_fields, &users, lz4, track_progress, &(job->metrics));
+                                         }));
+    }
+    stage_session session(opt.dbinfo);
+
+    // Up to extraction_workers tables are extracted in threads ahead of
+    // staging.
+    auto extract = [&](stage_job* job) -> bool {
+        table_schema& table = *(job->table);
+        extraction_files* ext_files = job->ext_files.get();
+
+        lg.write(log_level::detail, "", "", "updating table: " + table.name, -1);
+
+        if (reuse_files && progress.find(table.name) != progress.end() &&
+                extracted_files_exist(load_dir, table, source_states)) {
+            lg.trace(table.name + ": reusing extracted files");
+            return !opt.extract_only;
+        }
+
+        phase_timer phase;
+
+        for (auto& state : source_states) {
+
+            curl_wrapper curlw;
+            //if (!c.curl) {
+            //    // throw?
+            //}
+            string tenant_header = "X-Okapi-Tenant: ";
+            tenant_header + state.source.okapi_tenant;
+            string token_header = "X-Okapi-Token: ";
+            token_header += state.token;
+            curlw.headers = curl_slist_append(curlw.headers,
+                                              tenant_header.c_str());
+            curlw.headers = curl_slist_append(curlw.headers,
+                                              token_header.c_str());
+            curlw.headers = curl_slist_append(
+                curlw.headers, "Accept: application/json,text/plain");
+            curl_easy_setopt(curlw.curl, CURLOPT_HTTPHEADER,
+                             curlw.headers);
+
+            if (opt.load_from_dir == "") {
+                lg.write(log_level::debug, "update", table.name, "updating " + table.name, -1);
+                lg.write(log_level::trace, "", "", table.name + ": reading", -1);
+                bool found_data = false;
+                // if (direct_override(state.source, table.name)) {
+                //     found_data = retrieve_direct(state.source, &lg, table, load_dir, ext_files, opt.direct_extraction_no_ssl);
+                // } else {
+                //     if (table.source_type != data_source_type::srs_marc_records && table.source_type != data_source_type::srs_records &&
+                //         table.source_type != data_source_type::srs_error_records && table.source_type != data_source_type::direct_only) {
+                //         found_data = retrieve_pages(curlw, opt, state.source, &lg, state.token, table, load_dir, ext_files);
+                //     } else {
+                //         lg.write(log_level::debug, "", "", table.name + ": requires direct extraction", -1);
+                //     }
+                // }
+                found_data = retrieve_direct(state.source, &lg, &table, load_dir, ext_files, opt.direct_extraction_no_ssl);
+
+                if (!found_data) {
+                    lg.trace("no rows extracted, clearing table");
+                    // Clear old data from the table.
+                    {
+                        etymon::pgconn_lease conn(&conn_pool);
+                        string sql = "DELETE FROM " + table.name + ";";
+                        lg.detail(sql);
+                        { etymon::pgconn_result r(conn.conn, sql); }
                     }
-                    worker_pid = 0;
-                    worker_table_name = "";
+                    // No more processing is needed for this table.
+                    table.skip = true;
                 }
-                pid_t pid = fork();
-                if (pid == 0) {
-                    run_stage_merge(opt, &lg, &table, source_states, load_dir, &drop_fields, &users, lz4);
-                }
-                if (pid < 0) {
-                    throw runtime_error("error starting child process");
-                }
-                worker_pid = pid;
-                worker_table_name = table.name;
-                worker_ext_files = ext_files;
+                lg.trace(table.name + ": completed extraction");
+            }
+        } // for
+
+        if (opt.load_from_dir == "" && !table.skip) {
+            int64_t bytes = 0;
+            for (auto& file : ext_files->files) {
+                error_code ec;
+                uintmax_t size = fs::file_size(file, ec);
+                if (!ec)
+                    bytes += size;
+            }
+            phase.stop("extract", -1, bytes, &(job->metrics));
+        }
+
+        if (track_progress && opt.load_from_dir == "" && !table.skip) {
+            etymon::pgconn_lease conn(&conn_pool);
+            record_update_progress(conn.conn, &lg, table.name, "extracted");
+        }
+
+        return !(table.skip || opt.extract_only);
+    };
+    uintmax_t disk_limit = uintmax_t(opt.extraction_disk_limit) * 1048576;
+    extraction_pool extractor(&lg, opt.extraction_workers, disk_limit,
+                              opt.load_from_dir == "" ? load_dir : "", extract);
+
+    for (auto& table : schema.tables) {
+
+        if (!selected(table)) {
+            auto p = progress.find(table.name);
+            if (p != progress.end() && p->second == "indexed")
+                lg.trace(table.name + ": already updated");
+            continue;
+        }
+
+        //if (table.module_name != current_module) {
+        //    current_module = table.module_name;
+        //    lg.write(log_level::debug, "update", "", "module: " + current_module, -1);
+        //}
+
+        unique_ptr<stage_job> job(new stage_job());
+        job->table = &table;
+        job->drop_fields = &drop_fields;
+        job->ext_files.reset(new extraction_files(opt, &lg));
+        extractor.add(move(job));
+    }
+    extractor.start();
+
+    timer metrics_timer;
+    while (!extractor.finished()) {
+
+        // Start any ready tables for which workers have become free.
+        pool->service();
+
+        if (metrics_timer.elapsed_time() >= 60) {
+            metrics.set_queue(extractor.queued_count() + pool->ready_count(), pool->running_count());
+            etymon::pgconn_lease conn(&conn_pool);
+            metrics.write(conn.conn, &lg);
+            metrics_timer.restart();
+        }
+
+        unique_ptr<stage_job> job;
+        if (!extractor.wait_next(&job, chrono::seconds(1)))
+            continue;
+        table_schema& table = *(job->table);
+
+        try {
+
+            if (parallel) {  // worker process or thread
+                pool->submit(move(job));
             } else {  // single process
                 try {
-                    if (stage_merge(opt, &lg, &table, source_states, load_dir, &drop_fields, &users, lz4)) {
+                    bool ok = stage_merge(opt, &lg, &session, &table, source_states, load_dir, &drop_fields, &users, lz4, track_progress, &(job->metrics));
+                    session.reset();
+                    if (ok)
                         lg.write(log_level::trace, "", table.name, table.name + ": completed update", -1);
-                        delete ext_files;
-                    } else {
-                        delete ext_files;
-                        continue;
-                    }
                 } catch (runtime_error& e) {
+                    session.reset();
                     string s = e.what();
                     if ( !(s.empty()) && s.back() == '\n' )
                         s.pop_back();
-                    etymon::pgconn log_conn(opt.dbinfo);
-                    ldp_log lg(&log_conn, opt.lg_level, opt.console, opt.quiet);
                     lg.write(log_level::error, "update", "", s, -1);
                 }
             }
-        
-            //lg.write(log_level::debug, "update", table.name, table.name + ": updated", update_timer.elapsed_time());
 
         } catch (runtime_error& e) {
             string s = table.name + ": " + e.what();
             if ( !(s.empty()) && s.back() == '\n' )
                 s.pop_back();
-            etymon::pgconn log_conn(opt.dbinfo);
-            ldp_log lg(&log_conn, opt.lg_level, opt.console, opt.quiet);
             lg.write(log_level::error, "server", "", s, -1);
         }
 
-    } // for
-    if (opt.parallel_update) {
-        wait_stage_merge(worker_pid, worker_table_name, &lg);
-        if (worker_ext_files) {
-            delete worker_ext_files;
-            worker_ext_files = nullptr;
-        }
+    } // while
+    pool->wait_all();
+    extractor.log_summary();
+    {
+        metrics.set_queue(0, 0);
+        etymon::pgconn_lease conn(&conn_pool);
+        metrics.write(conn.conn, &lg);
+    }
+
+    if (track_progress) {
+        etymon::pgconn_lease conn(&conn_pool);
+        clear_update_progress(conn.conn, &lg);
+    }
+
+    if (predicted_makespan >= 0) {
+        char predicted[255];
+        sprintf(predicted, "%.0f", predicted_makespan);
+        lg.write(log_level::debug, "server", "", "updated tables (predicted time: " + string(predicted) + " s)", tables_timer.elapsed_time());
     }
 
     lg.write(log_level::debug, "server", "", "completed update", full_update_timer.elapsed_time());
 
     // Add optional columns
-    add_optional_columns(opt, &lg);
+    add_optional_columns(opt, &lg, partial_update ? &run_tables : nullptr);
 
     // Add comments on tables.
     if (!opt.extract_only) {
-        etymon::pgconn conn(opt.dbinfo);
+        etymon::pgconn_lease conn(&conn_pool);
+        etymon::pgconn_batch batch(conn.conn);
         for (auto& table : schema.tables) {
+            if (partial_update && run_tables.find(table.name) == run_tables.end())
+                continue;
             string sql;
             comment_sql(table.name, table.module_name, &sql);
-            { etymon::pgconn_result r(&conn, sql); }
+            batch.add(sql);
+            for (auto& array : table.arrays) {
+                comment_sql(array.name, table.module_name, &sql);
+                batch.add(sql);
+            }
         }
+        batch.execute();
     }
 
     // TODO Move analysis and constraints out of update process.
@@ -736,9 +1482,21 @@ void run_update(const ldp_options& opt, bool update_users)
         select_config_general(&conn, &lg, &detect_foreign_keys,
                &force_foreign_key_constraints, &enable_foreign_key_warnings);
 
+        // Foreign keys are processed for all tables together.
+        vector<phase_metrics> metrics;
+        phase_timer phase;
+
         // Always clear suggested_foreign_keys, even if foreign key detection
-        // is disabled.
-        string sql = "DELETE FROM dbsystem.suggested_foreign_keys;";
+        // is disabled.  If only some tables were updated, only suggestions
+        // from those tables are replaced.
+        string sql = "DELETE FROM dbsystem.suggested_foreign_keys";
+        if (partial_update) {
+            string list;
+            for (auto& t : run_tables)
+                list += (list == "" ? "'" : ", '") + t + "'";
+            sql += (list == "" ? "\n    WHERE FALSE" : "\n    WHERE referencing_table IN (" + list + ")");
+        }
+        sql += ";";
         lg.detail(sql);
         { etymon::pgconn_result r(&conn, sql); }
 
@@ -751,11 +1509,32 @@ void run_update(const ldp_options& opt, bool update_users)
 
             { etymon::pgconn_result r(&conn, "BEGIN;"); }
 
+            map<string,id_summary> summaries;
+            string ids_dir;
+            id_summary_dir(opt, &ids_dir);
+            for (auto& table : schema.tables) {
+                string path;
+                id_summary_path(ids_dir, table.name, &path);
+                try {
+                    if (summaries[table.name].read(path))
+                        continue;
+                } catch (runtime_error& e) {
+                    lg.write(log_level::warning, "server", "", "unable to read id summary: " + path, -1);
+                }
+                summaries.erase(table.name);
+            }
+            lg.write(log_level::trace, "", "", "read id summaries for " + to_string(summaries.size()) + " tables", -1);
+
+            // Queries that fail must not abort the transaction on conn.
+            etymon::pgconn_lease query_conn(&conn_pool);
             map<string, vector<reference>> refs;
             for (auto& table : schema.tables) {
-                search_table_foreign_keys(opt, &conn, &lg, schema, table, detect_foreign_keys, &refs);
+                if (partial_update && run_tables.find(table.name) == run_tables.end())
+                    continue;
+                search_table_foreign_keys(query_conn.conn, &lg, schema, table, summaries, &refs);
             }
 
+            etymon::pgconn_batch batch(&conn);
             for (pair<string, vector<reference>> p : refs) {
                 bool enable = (p.second.size() == 1);
                 for (auto& r : p.second) {
@@ -771,9 +1550,10 @@ void run_update(const ldp_options& opt, bool update_users)
                         "        '" + r.referenced_table + "',\n"
                         "        '" + r.referenced_column + "');";
                     lg.detail(sql);
-                    { etymon::pgconn_result r(&conn, sql); }
+                    batch.add(sql);
                 }
             }
+            batch.execute();
 
             { etymon::pgconn_result r(&conn, "COMMIT;"); }
 
@@ -789,15 +1569,29 @@ void run_update(const ldp_options& opt, bool update_users)
 
             timer ref_timer;
 
-            process_foreign_keys(opt, enable_foreign_key_warnings, force_foreign_key_constraints, &conn, &lg);
+            process_foreign_keys(opt, enable_foreign_key_warnings, force_foreign_key_constraints, partial_update ? &run_tables : nullptr, &conn_pool, &conn, &lg);
 
             lg.write(log_level::debug, "server", "",
                     "completed foreign key constraint processing",
                     ref_timer.elapsed_time());
         }
 
+        if (detect_foreign_keys || enable_foreign_key_warnings ||
+                force_foreign_key_constraints) {
+            phase.stop("foreign_keys", -1, -1, &metrics);
+            record_table_metrics(&conn, &lg, "", metrics);
+        }
+
+    }
+
+
+    {
+        metrics.end_update();
+        etymon::pgconn_lease conn(&conn_pool);
+        metrics.write(conn.conn, &lg);
     }
 
+    lg.write(log_level::debug, "server", "", "database connections: " + to_string(conn_pool.opened()) + " opened, " + to_string(conn_pool.reused()) + " reused, " + to_string(conn_pool.discarded()) + " discarded", -1);
 }
 
 //void run_update(const ldp_options& opt)
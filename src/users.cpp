@@ -46,28 +46,47 @@ bool read_users(const ldp_options& opt, ldp_log* lg, vector<string>* users, bool
     dbi.dbuser = opt.superuser;
     dbi.dbpasswd = opt.superpassword;
     etymon::pgconn conn(dbi);
+    etymon::pgconn_batch batch(&conn);
+    // Index of the first command queued for each user.
+    vector<size_t> first(usr.size() + 1, 0);
+    for (size_t x = 0; x < usr.size(); x++) {
+        const string& u = usr[x];
+        first[x] = batch.size();
+        string sql = "GRANT USAGE ON SCHEMA public TO " + u + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT USAGE ON SCHEMA history TO " + u + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT CREATE, USAGE ON SCHEMA local TO " + u + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT SELECT ON ALL TABLES IN SCHEMA public TO " + u + ";";
+        lg->detail(sql);
+        batch.add(sql);
+        sql = "GRANT SELECT ON ALL TABLES IN SCHEMA history TO " + u + ";";
+        lg->detail(sql);
+        batch.add(sql);
+    }
+    first[usr.size()] = batch.size();
+    vector<string> errors;
+    try {
+        batch.execute(&errors);
+    } catch (runtime_error& e) {
+        errors.assign(first[usr.size()], e.what());
+    }
     bool ok = true;
-    for (auto& u : usr) {
-        try {
-            string sql = "GRANT USAGE ON SCHEMA public TO " + u + ";";
-            lg->detail(sql);
-            { etymon::pgconn_result r(&conn, sql); }
-            sql = "GRANT USAGE ON SCHEMA history TO " + u + ";";
-            lg->detail(sql);
-            { etymon::pgconn_result r(&conn, sql); }
-            sql = "GRANT CREATE, USAGE ON SCHEMA local TO " + u + ";";
-            lg->detail(sql);
-            { etymon::pgconn_result r(&conn, sql); }
-            sql = "GRANT SELECT ON ALL TABLES IN SCHEMA public TO " + u + ";";
-            lg->detail(sql);
-            { etymon::pgconn_result r(&conn, sql); }
-            sql = "GRANT SELECT ON ALL TABLES IN SCHEMA history TO " + u + ";";
-            lg->detail(sql);
-            { etymon::pgconn_result r(&conn, sql); }
-            users->push_back(u);
-        } catch (runtime_error& e) {
+    for (size_t x = 0; x < usr.size(); x++) {
+        bool user_ok = true;
+        for (size_t y = first[x]; y < first[x + 1]; y++) {
+            if (errors[y] != "")
+                user_ok = false;
+        }
+        if (user_ok) {
+            users->push_back(usr[x]);
+        } else {
             ok = false;
-            lg->write(log_level::error, "server", "", "unable to set permissions for user \"" + u + "\"", -1);
+            lg->write(log_level::error, "server", "", "unable to set permissions for user \"" + usr[x] + "\"", -1);
         }
     }
     return ok;
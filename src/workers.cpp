@@ -0,0 +1,507 @@
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "progress.h"
+#include "util.h"
+#include "workers.h"
+
+namespace fs = std::filesystem;
+
+stage_session::stage_session(const etymon::pgconn_info& dbinfo) :
+    dbinfo(dbinfo)
+{
+    read_buffer = (char*) malloc(varchar_size);
+}
+
+stage_session::~stage_session()
+{
+    free(read_buffer);
+}
+
+etymon::pgconn* stage_session::connection()
+{
+    if (!conn)
+        conn.reset(new etymon::pgconn(dbinfo));
+    return conn.get();
+}
+
+/**
+ * \brief Records the latest completed phase of a table outside of the
+ * session's transaction.
+ *
+ * Errors are logged as warnings, and a connection that has failed is
+ * opened again on the next call.
+ */
+void stage_session::record_progress(ldp_log* lg, const string& table_name,
+                                    const char* phase)
+{
+    if (progress_conn && PQstatus(progress_conn->conn) != CONNECTION_OK)
+        progress_conn.reset();
+    try {
+        if (!progress_conn)
+            progress_conn.reset(new etymon::pgconn(dbinfo));
+    } catch (runtime_error& e) {
+        lg->write(log_level::warning, "", table_name, table_name + ": unable to record update progress: " + phase, -1);
+        return;
+    }
+    record_update_progress(progress_conn.get(), lg, table_name, phase);
+}
+
+/**
+ * \brief Rolls back any transaction left open by a failed table, or
+ * closes the connection if it cannot be reused.
+ */
+void stage_session::reset()
+{
+    if (!conn)
+        return;
+    if (PQstatus(conn->conn) != CONNECTION_OK) {
+        conn.reset();
+        return;
+    }
+    switch (PQtransactionStatus(conn->conn)) {
+    case PQTRANS_IDLE:
+        return;
+    case PQTRANS_INTRANS:
+    case PQTRANS_INERROR:
+        try {
+            { etymon::pgconn_result r(conn.get(), "ROLLBACK;"); }
+        } catch (runtime_error& e) {
+            conn.reset();
+        }
+        return;
+    default:
+        // A command such as COPY is still in progress.
+        conn.reset();
+    }
+}
+
+stage_worker_pool::stage_worker_pool(ldp_log* lg, size_t workers,
+                                     size_t max_ready,
+                                     function<void(stage_job*)> run) :
+    lg(lg),
+    workers(workers < 1 ? 1 : workers),
+    max_ready(max_ready),
+    run(run) {}
+
+stage_worker_pool::~stage_worker_pool()
+{
+    // Workers must not be orphaned while the parent still holds their
+    // extraction files.
+    try {
+        wait_all();
+    } catch (runtime_error& e) {}
+}
+
+/**
+ * \brief Adds an extracted table to the ready queue.
+ *
+ * If the ready queue is full, this blocks until a worker has finished
+ * and the table at the head of the queue has been started.
+ */
+void stage_worker_pool::submit(unique_ptr<stage_job> job)
+{
+    ready.push_back(move(job));
+    service();
+    while (ready.size() > max_ready) {
+        reap(true);
+        dispatch();
+    }
+}
+
+/**
+ * \brief Reaps any finished workers without blocking, and starts
+ * workers for ready tables while there are free slots.
+ */
+void stage_worker_pool::service()
+{
+    while (reap(false)) {}
+    dispatch();
+}
+
+void stage_worker_pool::wait_all()
+{
+    service();
+    while (ready.size() > 0 || running.size() > 0) {
+        reap(true);
+        dispatch();
+    }
+}
+
+size_t stage_worker_pool::ready_count() const
+{
+    return ready.size();
+}
+
+size_t stage_worker_pool::running_count() const
+{
+    return running.size();
+}
+
+void stage_worker_pool::dispatch()
+{
+    while (ready.size() > 0 && running.size() < workers) {
+        unique_ptr<stage_job> job = move(ready.front());
+        ready.pop_front();
+        // Extraction threads may be writing to the log.
+        lg->lock();
+        pid_t pid = fork();
+        lg->unlock();
+        if (pid == 0) {
+            run(job.get());
+            exit(1);
+        }
+        if (pid < 0)
+            throw runtime_error("error starting child process");
+        lg->write(log_level::trace, "", "", job->table->name + ": started worker: " + to_string(pid) + " (" + to_string(running.size() + 1) + " running, " + to_string(ready.size()) + " ready)", -1);
+        job->job_timer.restart();
+        running[pid] = move(job);
+    }
+}
+
+/**
+ * \brief Reaps one finished worker.
+ *
+ * \param[in] block Wait for a worker to finish if none has.
+ * \retval true A worker was reaped.
+ * \retval false No worker was reaped.
+ */
+bool stage_worker_pool::reap(bool block)
+{
+    if (running.size() == 0)
+        return false;
+    while (true) {
+        int stat;
+        pid_t pid = waitpid(-1, &stat, block ? 0 : WNOHANG);
+        if (pid == 0)
+            return false;
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error("error waiting for child process");
+        }
+        if (running.find(pid) == running.end())
+            continue;
+        finish(pid, stat);
+        return true;
+    }
+}
+
+void stage_worker_pool::finish(pid_t pid, int stat)
+{
+    unique_ptr<stage_job> job = move(running[pid]);
+    running.erase(pid);
+    const string& table_name = job->table->name;
+    if (WIFEXITED(stat) && WEXITSTATUS(stat) == 0) {
+        lg->write(log_level::trace, "", table_name, table_name + ": completed update", job->job_timer.elapsed_time());
+    } else {
+        if (WIFEXITED(stat))
+            lg->write(log_level::trace, "", "", table_name + ": exit status: " + to_string(WEXITSTATUS(stat)), -1);
+        else
+            lg->write(log_level::trace, "", "", table_name + ": worker did not terminate normally", -1);
+    }
+    // Deleting the job removes its extraction files.
+}
+
+stage_thread_pool::stage_thread_pool(ldp_log* lg,
+                                     const etymon::pgconn_info& dbinfo,
+                                     size_t workers, size_t max_ready,
+                                     function<void(stage_session*, stage_job*)> run) :
+    lg(lg),
+    dbinfo(dbinfo),
+    max_ready(max_ready),
+    run(run)
+{
+    if (workers < 1)
+        workers = 1;
+    for (size_t x = 0; x < workers; x++)
+        threads.push_back(thread(&stage_thread_pool::worker, this));
+}
+
+stage_thread_pool::~stage_thread_pool()
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+/**
+ * \brief Adds an extracted table to the ready queue.
+ *
+ * If the ready queue is full, this blocks until a worker thread has
+ * taken the table at the head of the queue.
+ */
+void stage_thread_pool::submit(unique_ptr<stage_job> job)
+{
+    unique_lock<mutex> lock(queue_mutex);
+    ready.push_back(move(job));
+    job_ready.notify_one();
+    job_taken.wait(lock, [&]{ return ready.size() <= max_ready; });
+}
+
+void stage_thread_pool::service()
+{
+    // Worker threads take ready tables themselves.
+}
+
+void stage_thread_pool::wait_all()
+{
+    unique_lock<mutex> lock(queue_mutex);
+    job_done.wait(lock, [&]{ return ready.size() == 0 && running == 0; });
+}
+
+size_t stage_thread_pool::ready_count() const
+{
+    lock_guard<mutex> lock(queue_mutex);
+    return ready.size();
+}
+
+size_t stage_thread_pool::running_count() const
+{
+    lock_guard<mutex> lock(queue_mutex);
+    return running;
+}
+
+void stage_thread_pool::worker()
+{
+    stage_session session(dbinfo);
+    while (true) {
+        unique_ptr<stage_job> job;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            job_ready.wait(lock, [&]{ return stopping || ready.size() > 0; });
+            if (ready.size() == 0)
+                return;
+            job = move(ready.front());
+            ready.pop_front();
+            running++;
+        }
+        job_taken.notify_all();
+        const string table_name = job->table->name;
+        job->job_timer.restart();
+        try {
+            lg->write(log_level::trace, "", "", table_name + ": started worker thread", -1);
+            run(&session, job.get());
+            lg->write(log_level::trace, "", table_name, table_name + ": completed update", job->job_timer.elapsed_time());
+        } catch (runtime_error& e) {
+            string s = e.what();
+            if ( !(s.empty()) && s.back() == '\n' )
+                s.pop_back();
+            // An exception cannot be allowed to escape the thread.
+            try {
+                lg->write(log_level::error, "server", "", table_name + ": " + s, -1);
+            } catch (runtime_error& e) {}
+        }
+        session.reset();
+        // Deleting the job removes its extraction files.
+        job.reset();
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            running--;
+        }
+        job_done.notify_all();
+    }
+}
+
+extraction_pool::extraction_pool(ldp_log* lg, size_t workers,
+                                 uintmax_t disk_limit, const string& dir,
+                                 function<bool(stage_job*)> extract) :
+    lg(lg),
+    workers(workers),
+    disk_limit(disk_limit),
+    dir(dir),
+    extract(extract) {}
+
+extraction_pool::~extraction_pool()
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void extraction_pool::add(unique_ptr<stage_job> job)
+{
+    lock_guard<mutex> lock(queue_mutex);
+    pending.push_back(move(job));
+}
+
+void extraction_pool::start()
+{
+    for (size_t x = 0; x < workers; x++)
+        threads.push_back(thread(&extraction_pool::worker, this));
+}
+
+/**
+ * \brief Takes the next extracted table.
+ *
+ * \param[out] job The extracted table.
+ * \param[in] timeout Maximum time to wait for a table.
+ * \retval true A table was taken.
+ * \retval false No table was extracted within the timeout.
+ */
+bool extraction_pool::wait_next(unique_ptr<stage_job>* job,
+                                chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(queue_mutex);
+    if (workers == 0) {
+        // Extract the next table in this thread.
+        while (extracted.size() == 0 && pending.size() > 0) {
+            unique_ptr<stage_job> next = move(pending.front());
+            pending.pop_front();
+            extracting++;
+            run_extract(move(next), &lock);
+        }
+        if (extracted.size() == 0)
+            return false;
+        *job = move(extracted.front());
+        extracted.pop_front();
+        return true;
+    }
+    if (!changed.wait_for(lock, timeout, [&]{ return extracted.size() > 0; }))
+        return false;
+    *job = move(extracted.front());
+    extracted.pop_front();
+    lock.unlock();
+    changed.notify_all();
+    return true;
+}
+
+/**
+ * \brief Checks whether all tables have been extracted and taken.
+ */
+bool extraction_pool::finished()
+{
+    lock_guard<mutex> lock(queue_mutex);
+    return pending.size() == 0 && extracting == 0 && extracted.size() == 0;
+}
+
+/**
+ * \brief Returns the number of tables waiting to be extracted or to be
+ * taken for staging.
+ */
+size_t extraction_pool::queued_count()
+{
+    lock_guard<mutex> lock(queue_mutex);
+    return pending.size() + extracted.size();
+}
+
+void extraction_pool::log_summary()
+{
+    lock_guard<mutex> lock(queue_mutex);
+    string msg = "extraction: at most " + to_string(peak_extracted) +
+        " tables waited for staging";
+    if (dir != "")
+        msg += ", temporary disk usage peaked at " +
+            to_string(peak_disk_usage / 1048576) + " MB";
+    lg->write(log_level::debug, "server", "", msg, -1);
+}
+
+// Called with queue_mutex held.
+bool extraction_pool::may_start()
+{
+    if (extracted.size() + extracting >= workers)
+        return false;
+    if (disk_limit == 0 || dir == "")
+        return true;
+    // Always allow one table in progress, so that a single table larger
+    // than the limit can still be updated.
+    if (extracted.size() == 0 && extracting == 0)
+        return true;
+    uintmax_t usage = disk_usage();
+    if (usage > peak_disk_usage)
+        peak_disk_usage = usage;
+    bool ok = usage < disk_limit;
+    if (!ok && !paused)
+        lg->write(log_level::trace, "", "", "extraction paused: temporary disk usage: " + to_string(usage / 1048576) + " MB", -1);
+    paused = !ok;
+    return ok;
+}
+
+uintmax_t extraction_pool::disk_usage() const
+{
+    // Files may be removed by staging workers during the scan.
+    uintmax_t usage = 0;
+    error_code ec;
+    for (fs::recursive_directory_iterator it(dir, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        error_code size_ec;
+        uintmax_t size = it->file_size(size_ec);
+        if (!size_ec)
+            usage += size;
+    }
+    return usage;
+}
+
+void extraction_pool::worker()
+{
+    unique_lock<mutex> lock(queue_mutex);
+    while (true) {
+        // Disk usage is checked again periodically, because it goes down
+        // when staging workers remove extraction files.
+        while (!stopping && pending.size() > 0 && !may_start())
+            changed.wait_for(lock, chrono::seconds(1));
+        if (stopping || pending.size() == 0)
+            return;
+        unique_ptr<stage_job> job = move(pending.front());
+        pending.pop_front();
+        extracting++;
+        run_extract(move(job), &lock);
+    }
+}
+
+/**
+ * \brief Extracts a table that has been counted as extracting, and
+ * queues it for staging if it is to be staged.
+ *
+ * This is called with queue_mutex held by lock, which is released
+ * during extraction.
+ */
+void extraction_pool::run_extract(unique_ptr<stage_job> job,
+                                  unique_lock<mutex>* lock)
+{
+    lock->unlock();
+
+    const string table_name = job->table->name;
+    bool ok = false;
+    try {
+        ok = extract(job.get());
+    } catch (runtime_error& e) {
+        string s = table_name + ": " + e.what();
+        if ( !(s.empty()) && s.back() == '\n' )
+            s.pop_back();
+        try {
+            lg->write(log_level::error, "server", "", s, -1);
+        } catch (runtime_error& e) {}
+    }
+    if (!ok) {
+        // Deleting the job removes its extraction files.
+        job.reset();
+    }
+
+    lock->lock();
+    extracting--;
+    if (ok) {
+        extracted.push_back(move(job));
+        if (extracted.size() > peak_extracted)
+            peak_extracted = extracted.size();
+        if (dir != "") {
+            uintmax_t usage = disk_usage();
+            if (usage > peak_disk_usage)
+                peak_disk_usage = usage;
+            lg->write(log_level::debug, "queue", "", table_name + ": extracted (" + to_string(extracting) + " extracting, " + to_string(extracted.size()) + " waiting for staging, " + to_string(usage / 1048576) + " MB in use)", -1);
+        }
+    }
+    changed.notify_all();
+}
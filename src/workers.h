@@ -0,0 +1,195 @@
+#ifndef LDP_WORKERS_H
+#define LDP_WORKERS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "anonymize.h"
+#include "extract.h"
+#include "log.h"
+#include "metrics.h"
+#include "schema.h"
+#include "timer.h"
+
+using namespace std;
+
+class stage_job {
+public:
+    table_schema* table = nullptr;
+    field_set* drop_fields = nullptr;
+    unique_ptr<extraction_files> ext_files;
+    timer job_timer;
+    // Metrics of the phases of updating the table.
+    vector<phase_metrics> metrics;
+};
+
+/**
+ * \brief Database connection and scratch buffer used to stage and
+ * merge tables.
+ *
+ * A session may be reused for a series of tables.  The connection is
+ * opened on first use, and reset() returns it to an idle state after
+ * each table.  Update progress is recorded on a second connection, also
+ * opened on first use, because the main connection is in a transaction
+ * while a table is staged and merged.
+ */
+class stage_session {
+public:
+    stage_session(const etymon::pgconn_info& dbinfo);
+    ~stage_session();
+    etymon::pgconn* connection();
+    void record_progress(ldp_log* lg, const string& table_name,
+                         const char* phase);
+    void reset();
+    char* read_buffer;
+private:
+    const etymon::pgconn_info& dbinfo;
+    unique_ptr<etymon::pgconn> conn;
+    unique_ptr<etymon::pgconn> progress_conn;
+};
+
+/**
+ * \brief Interface to run staging and merging of extracted tables
+ * concurrently with extraction.
+ */
+class stage_executor {
+public:
+    virtual ~stage_executor() {}
+    virtual void submit(unique_ptr<stage_job> job) = 0;
+    virtual void service() = 0;
+    virtual void wait_all() = 0;
+    virtual size_t ready_count() const = 0;
+    virtual size_t running_count() const = 0;
+};
+
+/**
+ * \brief Runs staging and merging of tables in forked worker
+ * processes.
+ *
+ * Tables that have been extracted are submitted to a queue of ready
+ * tables, from which up to a fixed number of worker processes are
+ * started.  Finished workers are reaped without blocking whenever
+ * the queue is serviced.  Each worker owns the extraction files of its
+ * table, which are removed when the worker has been reaped.
+ *
+ * Workers are forked from the calling thread, and so this must not be
+ * used while other threads may be running in libpq, OpenSSL, or curl:
+ * a worker could inherit one of their locks in a locked state and
+ * deadlock.
+ */
+class stage_worker_pool : public stage_executor {
+public:
+    stage_worker_pool(ldp_log* lg, size_t workers, size_t max_ready,
+                      function<void(stage_job*)> run);
+    ~stage_worker_pool();
+    void submit(unique_ptr<stage_job> job) override;
+    void service() override;
+    void wait_all() override;
+    size_t ready_count() const override;
+    size_t running_count() const override;
+private:
+    void dispatch();
+    bool reap(bool block);
+    void finish(pid_t pid, int stat);
+    ldp_log* lg;
+    size_t workers;
+    size_t max_ready;
+    function<void(stage_job*)> run;
+    deque<unique_ptr<stage_job>> ready;
+    map<pid_t, unique_ptr<stage_job>> running;
+};
+
+/**
+ * \brief Runs staging and merging of tables in worker threads.
+ *
+ * Each thread keeps its own stage_session for the tables that it
+ * processes, which avoids connecting and allocating buffers for every
+ * table.  The schema, drop fields, and users are shared with the
+ * extracting thread and must not be modified while workers are
+ * running, except for the table_schema of each job, which belongs to
+ * the thread processing it.
+ */
+class stage_thread_pool : public stage_executor {
+public:
+    stage_thread_pool(ldp_log* lg, const etymon::pgconn_info& dbinfo,
+                      size_t workers, size_t max_ready,
+                      function<void(stage_session*, stage_job*)> run);
+    ~stage_thread_pool();
+    void submit(unique_ptr<stage_job> job) override;
+    void service() override;
+    void wait_all() override;
+    size_t ready_count() const override;
+    size_t running_count() const override;
+private:
+    void worker();
+    ldp_log* lg;
+    const etymon::pgconn_info& dbinfo;
+    size_t max_ready;
+    function<void(stage_session*, stage_job*)> run;
+    mutable mutex queue_mutex;
+    condition_variable job_ready;
+    condition_variable job_taken;
+    condition_variable job_done;
+    deque<unique_ptr<stage_job>> ready;
+    size_t running = 0;
+    bool stopping = false;
+    vector<thread> threads;
+};
+
+/**
+ * \brief Extracts tables in worker threads ahead of staging.
+ *
+ * Tables are added in the order in which they should be extracted,
+ * and extracted tables are taken by the caller in the order in which
+ * they finish.  At most a fixed number of tables are being extracted
+ * or waiting to be taken, so that extraction pauses when staging falls
+ * behind.  If a disk limit is set, no new extraction is started while
+ * the extraction directory uses more space than the limit, unless no
+ * other table is being extracted or waiting.
+ *
+ * With zero workers, no threads are started, and each table is
+ * extracted in the calling thread when it is taken.
+ */
+class extraction_pool {
+public:
+    extraction_pool(ldp_log* lg, size_t workers, uintmax_t disk_limit,
+                    const string& dir, function<bool(stage_job*)> extract);
+    ~extraction_pool();
+    void add(unique_ptr<stage_job> job);
+    void start();
+    bool wait_next(unique_ptr<stage_job>* job, chrono::milliseconds timeout);
+    bool finished();
+    size_t queued_count();
+    void log_summary();
+private:
+    void worker();
+    void run_extract(unique_ptr<stage_job> job, unique_lock<mutex>* lock);
+    bool may_start();
+    uintmax_t disk_usage() const;
+    ldp_log* lg;
+    size_t workers;
+    uintmax_t disk_limit;
+    string dir;
+    function<bool(stage_job*)> extract;
+    mutex queue_mutex;
+    condition_variable changed;
+    deque<unique_ptr<stage_job>> pending;
+    deque<unique_ptr<stage_job>> extracted;
+    size_t extracting = 0;
+    bool stopping = false;
+    bool paused = false;
+    size_t peak_extracted = 0;
+    uintmax_t peak_disk_usage = 0;
+    vector<thread> threads;
+};
+
+#endif
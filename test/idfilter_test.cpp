@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <filesystem>
+#include <set>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/idfilter.h"
+
+namespace fs = std::filesystem;
+
+static string test_id(int n)
+{
+    char id[64];
+    snprintf(id, sizeof id, "%08x-1111-4222-8333-%012x", n, n * 7919);
+    return id;
+}
+
+TEST_CASE( "Test that the id filter contains all added ids", "[idfilter]" ) {
+    id_filter f;
+    f.init(10000);
+    for (int x = 0; x < 10000; x++)
+        f.add(test_id(x).c_str());
+    int missing = 0;
+    for (int x = 0; x < 10000; x++) {
+        if (!f.may_contain(test_id(x)))
+            missing++;
+    }
+    CHECK( missing == 0 );
+}
+
+TEST_CASE( "Test the false positive rate of the id filter", "[idfilter]" ) {
+    id_filter f;
+    f.init(10000);
+    for (int x = 0; x < 10000; x++)
+        f.add(test_id(x).c_str());
+    int found = 0;
+    for (int x = 10000; x < 110000; x++) {
+        if (f.may_contain(test_id(x)))
+            found++;
+    }
+    // The filter is sized for about 1%.
+    CHECK( found < 2000 );
+}
+
+TEST_CASE( "Test that the id filter ignores case", "[idfilter]" ) {
+    id_filter f;
+    f.init(1);
+    f.add("0A1B2C3D-1111-4222-8333-ABCDEF012345");
+    CHECK( f.may_contain("0a1b2c3d-1111-4222-8333-abcdef012345") );
+}
+
+TEST_CASE( "Test an id filter built for no ids", "[idfilter]" ) {
+    id_filter f;
+    f.init(0);
+    CHECK( f.bits.size() == 1 );
+    CHECK( !f.may_contain(test_id(1)) );
+    f.add(test_id(1).c_str());
+    CHECK( f.may_contain(test_id(1)) );
+}
+
+TEST_CASE( "Test sampling of reference values", "[idfilter]" ) {
+    id_summary s;
+    for (int x = 0; x < 10000; x++)
+        s.add_reference("item_id", test_id(x).c_str());
+    vector<string>& sample = s.references["item_id"];
+    REQUIRE( sample.size() == 256 );
+    // The sample should not be only the first values.
+    set<string> first;
+    for (int x = 0; x < 256; x++)
+        first.insert(test_id(x));
+    int later = 0;
+    for (auto& v : sample) {
+        if (first.find(v) == first.end())
+            later++;
+    }
+    CHECK( later > 128 );
+}
+
+TEST_CASE( "Test writing and reading an id summary", "[idfilter]" ) {
+    id_summary s;
+    s.ids.init(100);
+    for (int x = 0; x < 100; x++)
+        s.ids.add(test_id(x).c_str());
+    s.add_reference("holdings_id", "ABC");
+    s.add_reference("holdings_id", "abc");
+    s.add_reference("item_id", "def");
+    string filename = fs::temp_directory_path() /
+        ("ldp_idfilter_test_" + to_string(getpid()));
+    s.write(filename);
+    id_summary r;
+    bool ok = r.read(filename);
+    fs::remove(filename);
+    REQUIRE( ok );
+    CHECK( r.ids.bits == s.ids.bits );
+    CHECK( r.references["holdings_id"] == vector<string>({"abc"}) );
+    CHECK( r.references["item_id"] == vector<string>({"def"}) );
+}
@@ -0,0 +1,19 @@
+#include "test.h"
+#include "../src/names.h"
+
+TEST_CASE( "Test expanding nested field paths to column names", "[names]" ) {
+    vector<pair<string, string>> tests = {
+        {"", ""},
+        {"id", "id"},
+        {"metadata/created_date", "metadata__created_date"},
+        {"a/b/c", "a__b__c"},
+        {"a//b", "a____b"},
+        {"/a/", "__a__"},
+        {"a__b", "a__b"}
+    };
+    for (auto& t : tests) {
+        string s;
+        expand_column_name(t.first, &s);
+        CHECK( s == t.second );
+    }
+}
@@ -0,0 +1,45 @@
+#include "test.h"
+#include "../src/notify.h"
+
+static void make_schema(ldp_schema* schema)
+{
+    vector<string> names = {"circulation_loans", "inventory_items",
+        "user_users"};
+    for (auto& name : names) {
+        table_schema table;
+        table.name = name;
+        schema->tables.push_back(table);
+    }
+}
+
+TEST_CASE( "Test parsing of update request payloads", "[notify]" ) {
+    ldp_log lg(log_level::info, false, true, nullptr);
+    ldp_schema schema;
+    make_schema(&schema);
+    vector<pair<string, set<string>>> tests = {
+        {"", {}},
+        {" , ,", {}},
+        {"inventory_items", {"inventory_items"}},
+        {"inventory_items,user_users", {"inventory_items", "user_users"}},
+        {"inventory_items user_users", {"inventory_items", "user_users"}},
+        {" inventory_items ,\tuser_users, ", {"inventory_items", "user_users"}},
+        {"inventory_items,inventory_items", {"inventory_items"}},
+        {"unknown_table,user_users", {"user_users"}},
+        {"Inventory_Items", {}}
+    };
+    for (auto& t : tests) {
+        set<string> tables;
+        add_requested_tables(&lg, schema, t.first, &tables);
+        CHECK( tables == t.second );
+    }
+}
+
+TEST_CASE( "Test that update requests are combined", "[notify]" ) {
+    ldp_log lg(log_level::info, false, true, nullptr);
+    ldp_schema schema;
+    make_schema(&schema);
+    set<string> tables;
+    add_requested_tables(&lg, schema, "inventory_items", &tables);
+    add_requested_tables(&lg, schema, "user_users,inventory_items", &tables);
+    CHECK( tables == set<string>({"inventory_items", "user_users"}) );
+}
@@ -0,0 +1,62 @@
+#include "test.h"
+#include "../src/schedule.h"
+
+static void make_tables(const vector<string>& names,
+                        vector<table_schema>* tables)
+{
+    tables->clear();
+    for (auto& name : names) {
+        table_schema table;
+        table.name = name;
+        tables->push_back(table);
+    }
+}
+
+static vector<string> table_names(const vector<table_schema>& tables)
+{
+    vector<string> names;
+    for (auto& table : tables)
+        names.push_back(table.name);
+    return names;
+}
+
+TEST_CASE( "Test ordering of tables by cost", "[schedule]" ) {
+    map<string,double> costs = {{"a", 1}, {"b", 5}, {"c", 3}, {"d", 5}};
+    vector<table_schema> tables;
+    make_tables({"a", "b", "c", "d", "e", "f"}, &tables);
+    order_tables_by_cost(costs, 2, &tables);
+    // Tables without a cost follow in their existing order, and ties
+    // keep their existing order.
+    CHECK( table_names(tables) ==
+           vector<string>({"b", "d", "c", "a", "e", "f"}) );
+}
+
+TEST_CASE( "Test predicted time of ordered tables", "[schedule]" ) {
+    map<string,double> costs = {{"a", 2}, {"b", 3}, {"c", 4}, {"d", 5},
+        {"e", 6}, {"f", 7}};
+    vector<table_schema> tables;
+    make_tables({"a", "b", "c", "d", "e", "f"}, &tables);
+    // Two workers: {7, 4, 3} and {6, 5, 2}.
+    CHECK( order_tables_by_cost(costs, 2, &tables) == 14 );
+    CHECK( order_tables_by_cost(costs, 1, &tables) == 27 );
+    CHECK( order_tables_by_cost(costs, 0, &tables) == 27 );
+    // With a worker per table, the longest table decides.
+    CHECK( order_tables_by_cost(costs, 6, &tables) == 7 );
+    CHECK( order_tables_by_cost(costs, 10, &tables) == 7 );
+}
+
+TEST_CASE( "Test predicted time of a long table", "[schedule]" ) {
+    map<string,double> costs = {{"a", 1}, {"b", 1}, {"c", 1}, {"d", 10}};
+    vector<table_schema> tables;
+    make_tables({"a", "b", "c", "d"}, &tables);
+    CHECK( order_tables_by_cost(costs, 2, &tables) == 10 );
+    CHECK( tables[0].name == "d" );
+}
+
+TEST_CASE( "Test predicted time of tables without costs", "[schedule]" ) {
+    map<string,double> costs;
+    vector<table_schema> tables;
+    make_tables({"b", "a"}, &tables);
+    CHECK( order_tables_by_cost(costs, 4, &tables) == 0 );
+    CHECK( table_names(tables) == vector<string>({"b", "a"}) );
+}
@@ -0,0 +1,110 @@
+#include "test.h"
+#include "../src/schemacache.h"
+
+static column_schema make_column(const string& source_name, const string& name,
+                                 column_type type, unsigned int length,
+                                 double distinct_count, double null_ratio,
+                                 double selectivity)
+{
+    column_schema column;
+    column.source_name = source_name;
+    column.name = name;
+    column.type = type;
+    column.length = length;
+    column.distinct_count = distinct_count;
+    column.null_ratio = null_ratio;
+    column.selectivity = selectivity;
+    return column;
+}
+
+TEST_CASE( "Test encoding and decoding cached columns", "[schemacache]" ) {
+    vector<column_schema> columns = {
+        make_column("id", "id", column_type::id, 0, 1000, 0, 1),
+        make_column("barcode", "barcode", column_type::varchar, 4096, 998, 0.25, 0.998),
+        make_column("metadata/createdDate", "metadata__created_date", column_type::timestamptz, 0, -1, -1, -1),
+        make_column("active", "active", column_type::boolean, 0, 2, 0.5, 0.002),
+        make_column("count", "count", column_type::bigint, 0, 17, 0, 0.017),
+        make_column("amount", "amount", column_type::numeric, 0, 0, 1, 0)
+    };
+    string text;
+    encode_columns(columns, &text);
+    vector<column_schema> decoded;
+    REQUIRE( decode_columns(text, &decoded) );
+    REQUIRE( decoded.size() == columns.size() );
+    for (size_t x = 0; x < columns.size(); x++) {
+        CHECK( decoded[x].source_name == columns[x].source_name );
+        CHECK( decoded[x].name == columns[x].name );
+        CHECK( decoded[x].type == columns[x].type );
+        CHECK( decoded[x].length == columns[x].length );
+        CHECK( decoded[x].distinct_count == columns[x].distinct_count );
+        CHECK( decoded[x].null_ratio == columns[x].null_ratio );
+        CHECK( decoded[x].selectivity == columns[x].selectivity );
+    }
+}
+
+TEST_CASE( "Test decoding no cached columns", "[schemacache]" ) {
+    vector<column_schema> columns;
+    CHECK( decode_columns("", &columns) );
+    CHECK( columns.empty() );
+}
+
+TEST_CASE( "Test rejecting malformed cached columns", "[schemacache]" ) {
+    vector<string> tests = {
+        "id\tid\t2\t0\t1000\t0\n",
+        "id\tid\t2\t0\t1000\t0\t1\textra\n",
+        "id id 2 0 1000 0 1\n",
+        "\tid\t2\t0\t1000\t0\t1\n",
+        "id\t\t2\t0\t1000\t0\t1\n",
+        "id\tid\t\t0\t1000\t0\t1\n",
+        "id\tid\tx\t0\t1000\t0\t1\n",
+        "id\tid\t2x\t0\t1000\t0\t1\n",
+        "id\tid\t-1\t0\t1000\t0\t1\n",
+        "id\tid\t6\t0\t1000\t0\t1\n",
+        "id\tid\t2\t-1\t1000\t0\t1\n",
+        "id\tid\t2\tlong\t1000\t0\t1\n",
+        "id\tid\t2\t0\tmany\t0\t1\n",
+        "id\tid\t2\t0\t1000\t\t1\n",
+        "id\tid\t2\t0\t1000\t0\t1.0.0\n",
+        "id\tid\t2\t0\t1000\t0\t1\nbarcode\tbarcode\t5\n"
+    };
+    for (auto& t : tests) {
+        vector<column_schema> columns;
+        CHECK( !decode_columns(t, &columns) );
+    }
+}
+
+TEST_CASE( "Test fingerprints of cached schemas", "[schemacache]" ) {
+    table_schema table;
+    table.name = "inventory_items";
+    table.source_spec = "/item-storage/items";
+    field_set drop_fields;
+    string columns = "id\tid\t2\t0\t1000\t0\t1\n";
+    string base;
+    schema_fingerprint(table, drop_fields, 2, columns, &base);
+
+    string fp;
+    schema_fingerprint(table, drop_fields, 2, columns, &fp);
+    CHECK( fp == base );
+
+    schema_fingerprint(table, drop_fields, 3, columns, &fp);
+    CHECK( fp != base );
+
+    schema_fingerprint(table, drop_fields, 2, "id\tid\t2\t0\t999\t0\t1\n", &fp);
+    CHECK( fp != base );
+
+    table_schema flattened = table;
+    flattened.flatten_paths.push_back("/status");
+    schema_fingerprint(flattened, drop_fields, 2, columns, &fp);
+    CHECK( fp != base );
+
+    field_set dropped;
+    dropped.fields.insert(make_pair(string("inventory_items"), string("/barcode")));
+    schema_fingerprint(table, dropped, 2, columns, &fp);
+    CHECK( fp != base );
+
+    // Fields dropped from other tables do not affect this table.
+    field_set other;
+    other.fields.insert(make_pair(string("user_users"), string("/barcode")));
+    schema_fingerprint(table, other, 2, columns, &fp);
+    CHECK( fp == base );
+}
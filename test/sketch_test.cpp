@@ -0,0 +1,41 @@
+#include <cmath>
+
+#include "test.h"
+#include "../src/sketch.h"
+
+static double estimate_distinct(int distinct, int repeats)
+{
+    hll_sketch s;
+    for (int r = 0; r < repeats; r++) {
+        for (int x = 0; x < distinct; x++) {
+            string v = "value-" + to_string(x);
+            s.add(v.data(), v.size());
+        }
+    }
+    return s.estimate();
+}
+
+TEST_CASE( "Test estimates of an empty sketch", "[sketch]" ) {
+    hll_sketch s;
+    CHECK( s.estimate() == 0 );
+}
+
+TEST_CASE( "Test estimates of small numbers of distinct values", "[sketch]" ) {
+    vector<int> tests = {1, 10, 100, 1000};
+    for (int n : tests) {
+        double e = estimate_distinct(n, 3);
+        CHECK( fabs(e - n) <= n * 0.05 + 1 );
+    }
+}
+
+TEST_CASE( "Test estimates of large numbers of distinct values", "[sketch]" ) {
+    vector<int> tests = {20000, 100000, 1000000};
+    for (int n : tests) {
+        double e = estimate_distinct(n, 1);
+        CHECK( fabs(e - n) <= n * 0.06 );
+    }
+}
+
+TEST_CASE( "Test that repeated values are not counted", "[sketch]" ) {
+    CHECK( estimate_distinct(50000, 4) == estimate_distinct(50000, 1) );
+}
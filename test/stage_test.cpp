@@ -0,0 +1,90 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#include "test.h"
+#include "../src/stage.h"
+
+namespace fs = std::filesystem;
+
+// Writes the array rows of a record and returns the contents of the file
+// for each array.
+static void write_rows(const table_schema& table, const string& record,
+                       vector<string>* files)
+{
+    rapidjson::Document doc;
+    doc.Parse(record.c_str());
+    REQUIRE( !doc.HasParseError() );
+    dbtype dbt(nullptr);
+    vector<unique_ptr<array_rows>> arrays;
+    for (size_t x = 0; x < table.arrays.size(); x++) {
+        string path = fs::temp_directory_path() /
+            ("ldp_stage_test_" + to_string(getpid()) + "_" + to_string(x));
+        arrays.push_back(unique_ptr<array_rows>(new array_rows(path)));
+    }
+    write_array_rows(dbt, table, doc, "6b7d9f7c-5d7e-4b8e-9c3e-3f1f2e0c9a11", &arrays);
+    files->clear();
+    for (auto& rows : arrays) {
+        fflush(rows->f.fp);
+        ifstream in(rows->path);
+        stringstream ss;
+        ss << in.rdbuf();
+        files->push_back(ss.str());
+    }
+}
+
+static void make_table(table_schema* table)
+{
+    table->name = "inventory_holdings";
+    array_table_schema a1;
+    a1.path = "/formerIds";
+    a1.name = "inventory_holdings__former_ids";
+    table->arrays.push_back(a1);
+    array_table_schema a2;
+    a2.path = "/holdingsStatements";
+    a2.name = "inventory_holdings__holdings_statements";
+    table->arrays.push_back(a2);
+}
+
+TEST_CASE( "Test writing rows of array elements", "[stage]" ) {
+    table_schema table;
+    make_table(&table);
+    vector<string> files;
+    write_rows(table,
+               "{\"id\": \"6b7d9f7c-5d7e-4b8e-9c3e-3f1f2e0c9a11\","
+               " \"formerIds\": [\"a\", 12, true, null, \"tab\\there\"],"
+               " \"holdingsStatements\": [{\"statement\": \"v. 1\"}, [1, 2]]}",
+               &files);
+    REQUIRE( files.size() == 2 );
+    string id = "6b7d9f7c-5d7e-4b8e-9c3e-3f1f2e0c9a11";
+    // Scalar elements are stored as text and JSON, other elements only
+    // as JSON; positions start at 1.
+    CHECK( files[0] ==
+           id + "\t1\ta\t\"a\"\n" +
+           id + "\t2\t12\t12\n" +
+           id + "\t3\ttrue\ttrue\n" +
+           id + "\t4\t\\N\tnull\n" +
+           id + "\t5\ttab\\there\t\"tab\\\\there\"\n" );
+    CHECK( files[1] ==
+           id + "\t1\t\\N\t{\"statement\":\"v. 1\"}\n" +
+           id + "\t2\t\\N\t[1,2]\n" );
+}
+
+TEST_CASE( "Test writing rows of missing or empty arrays", "[stage]" ) {
+    table_schema table;
+    make_table(&table);
+    vector<string> files;
+    write_rows(table,
+               "{\"id\": \"6b7d9f7c-5d7e-4b8e-9c3e-3f1f2e0c9a11\","
+               " \"formerIds\": [],"
+               " \"holdingsStatements\": {\"statement\": \"v. 1\"}}",
+               &files);
+    REQUIRE( files.size() == 2 );
+    CHECK( files[0] == "" );
+    CHECK( files[1] == "" );
+    write_rows(table, "{\"id\": \"6b7d9f7c-5d7e-4b8e-9c3e-3f1f2e0c9a11\"}",
+               &files);
+    CHECK( files[0] == "" );
+    CHECK( files[1] == "" );
+}